@@ -1,18 +1,188 @@
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <string>
 #include <cstring>
 #include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <map>
+#include <deque>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <atomic>
+#include <climits>
+#include <set>
+#include <memory>
+#include <string_view>
+#include <charconv>
+#include <cmath>
+#include <random>
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define HMS_CRC32_INSTRUCTION
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
+enum MemoryTag
+{
+    MEM_PATIENT_RECORDS,
+    MEM_PATIENT_LISTS,
+    MEM_RIGHTS,
+    MEM_MENUS,
+    MEM_USERS,
+    MEM_EXCEPTIONS,
+    MEM_BEDS,
+    MEM_TAG_COUNT
+};
+
+// Opt-in (--track-memory) live bytes, peak bytes and allocation counts for
+// the subsystems that manage raw memory by hand. Off, each hook costs one
+// predictable branch. Patient records are the registry itself and stay
+// resident; every other tag must be back to zero at exit, and anything
+// left over is reported as a leak.
+class MemoryAccounting
+{
+    struct Counters
+    {
+        atomic<long long> live{0}, peak{0}, allocations{0}, frees{0};
+    };
+
+    static bool enabled;
+    static Counters counters[MEM_TAG_COUNT];
+    static const char *const tagNames[MEM_TAG_COUNT];
+
+    static void checkAtExit()
+    {
+        report();
+        bool clean = true;
+        for (int t = MEM_PATIENT_LISTS; t < MEM_TAG_COUNT; t++)
+        {
+            long long live = counters[t].live, blocks = counters[t].allocations - counters[t].frees;
+            if (live || blocks)
+            {
+                cout << "Leak: " << tagNames[t] << " still holds " << live << " byte(s) in " << blocks << " allocation(s)\n";
+                clean = false;
+            }
+        }
+        if (clean)
+            cout << "No leaks.\n";
+    }
+
+public:
+    // Call before anything is allocated; the counts are checked at exit
+    static void enable()
+    {
+        enabled = true;
+        atexit(checkAtExit);
+    }
+
+    static bool isEnabled() { return enabled; }
+
+    static void allocated(MemoryTag tag, size_t bytes)
+    {
+        if (!enabled)
+            return;
+        Counters &c = counters[tag];
+        long long live = c.live += (long long)bytes, peak = c.peak;
+        while (live > peak && !c.peak.compare_exchange_weak(peak, live))
+            ;
+        c.allocations++;
+    }
+
+    static void freed(MemoryTag tag, size_t bytes)
+    {
+        if (!enabled)
+            return;
+        counters[tag].live -= (long long)bytes;
+        counters[tag].frees++;
+    }
+
+    static char *copyString(MemoryTag tag, const char *text)
+    {
+        size_t bytes = strlen(text) + 1;
+        char *copy = new char[bytes];
+        memcpy(copy, text, bytes);
+        allocated(tag, bytes);
+        return copy;
+    }
+
+    static void freeString(MemoryTag tag, char *text)
+    {
+        if (!text)
+            return;
+        freed(tag, strlen(text) + 1);
+        delete[] text;
+    }
+
+    template <typename T>
+    static T *newArray(MemoryTag tag, size_t count)
+    {
+        allocated(tag, count * sizeof(T));
+        return new T[count];
+    }
+
+    template <typename T>
+    static void deleteArray(MemoryTag tag, T *items, size_t count)
+    {
+        freed(tag, count * sizeof(T));
+        delete[] items;
+    }
+
+    static void report()
+    {
+        cout << "Subsystem              live bytes    peak bytes   allocations         frees\n";
+        for (int t = 0; t < MEM_TAG_COUNT; t++)
+        {
+            const Counters &c = counters[t];
+            cout << left << setw(20) << tagNames[t] << right << setw(14) << c.live << setw(14) << c.peak
+                 << setw(14) << c.allocations << setw(14) << c.frees << "\n";
+        }
+    }
+};
+
+bool MemoryAccounting::enabled = false;
+MemoryAccounting::Counters MemoryAccounting::counters[MEM_TAG_COUNT];
+const char *const MemoryAccounting::tagNames[MEM_TAG_COUNT] = {"patient records", "patient lists", "access rights",
+                                                                 "menus", "users", "exceptions", "beds"};
+
+// Exceptions are reserved for failures such as I/O errors; bad keyboard
+// input goes through InputValidator instead. The message lives inline so
+// constructing and copying an exception never allocates.
 class HospitalException : public exception
 {
-    char *message;
+    char message[160];
 
 public:
-    HospitalException(const char *msg) : message(new char[strlen(msg) + 1]) { strcpy(message, msg); }
-    ~HospitalException() { delete[] message; }
+    // The runtime allocates thrown objects, so they are counted by lifetime
+    HospitalException(const char *msg)
+    {
+        strncpy(message, msg, sizeof message - 1);
+        message[sizeof message - 1] = '\0';
+        MemoryAccounting::allocated(MEM_EXCEPTIONS, sizeof *this);
+    }
+    HospitalException(const HospitalException &other) : exception(other)
+    {
+        memcpy(message, other.message, sizeof message);
+        MemoryAccounting::allocated(MEM_EXCEPTIONS, sizeof *this);
+    }
+    ~HospitalException() { MemoryAccounting::freed(MEM_EXCEPTIONS, sizeof *this); }
     const char *what() const throw() { return message; }
 };
 
@@ -46,676 +216,7300 @@ public:
     PermissionDeniedException() : HospitalException("Permission denied: The administrator has restricted your access to this function") {}
 };
 
+class VersionConflictException : public HospitalException
+{
+public:
+    VersionConflictException() : HospitalException("Record was changed by another user since it was loaded") {}
+};
+
+enum class InputError
+{
+    None,
+    Empty,
+    InvalidCharacter,
+    TooLarge,
+    OutOfRange
+};
+
+template <typename T>
+struct Validated
+{
+    T value;
+    InputError error;
+
+    bool ok() const { return error == InputError::None; }
+};
+
+// Validation for every interactive field. Failures come back as error codes
+// so a bad keystroke costs a branch instead of a throw and unwind.
+class InputValidator
+{
+    static bool isBlank(const string &input)
+    {
+        for (char c : input)
+            if (!isspace((unsigned char)c))
+                return false;
+        return true;
+    }
+
+public:
+    static Validated<int> parseNumber(const string &input, int min, int max)
+    {
+        if (input.empty())
+            return {0, InputError::Empty};
+
+        long long value = 0;
+        for (char c : input)
+        {
+            if (!isdigit((unsigned char)c))
+                return {0, InputError::InvalidCharacter};
+            value = value * 10 + (c - '0');
+            if (value > INT_MAX)
+                return {0, InputError::TooLarge};
+        }
+
+        if (value < min || value > max)
+            return {(int)value, InputError::OutOfRange};
+        return {(int)value, InputError::None};
+    }
+
+    static InputError checkName(const string &input)
+    {
+        if (input.empty() || isBlank(input))
+            return InputError::Empty;
+        for (char c : input)
+            if (!isalpha((unsigned char)c) && !isspace((unsigned char)c))
+                return InputError::InvalidCharacter;
+        return InputError::None;
+    }
+
+    static Validated<int> parseAge(const string &input) { return parseNumber(input, 1, 150); }
+
+    static Validated<char> parseGender(const string &input)
+    {
+        if (input.length() != 1)
+            return {'\0', input.empty() ? InputError::Empty : InputError::InvalidCharacter};
+        char gender = (char)toupper((unsigned char)input[0]);
+        if (gender != 'M' && gender != 'F' && gender != 'O')
+            return {'\0', InputError::InvalidCharacter};
+        return {gender, InputError::None};
+    }
+
+    static InputError checkAddress(const string &input)
+    {
+        if (input.empty() || isBlank(input))
+            return InputError::Empty;
+        for (char c : input)
+            if (!isalnum((unsigned char)c) && !isspace((unsigned char)c) && c != ',' && c != '.' && c != '-' && c != '/' && c != '#')
+                return InputError::InvalidCharacter;
+        return InputError::None;
+    }
+
+    // Usernames double as audit actors, so they must fit AuditEvent::actor
+    static InputError checkUsername(const string &input)
+    {
+        if (input.empty())
+            return InputError::Empty;
+        if (input.size() > 18)
+            return InputError::TooLarge;
+        for (char c : input)
+            if (!isalnum((unsigned char)c) && c != '.' && c != '_' && c != '-')
+                return InputError::InvalidCharacter;
+        return InputError::None;
+    }
+
+    static InputError checkContact(const string &input)
+    {
+        if (input.empty())
+            return InputError::Empty;
+        for (char c : input)
+            if (!isdigit((unsigned char)c))
+                return InputError::InvalidCharacter;
+        return InputError::None;
+    }
+};
+
+// Interning pool for low-cardinality text such as addresses and diagnoses.
+// Each distinct string is stored once in an append-only arena and patients
+// hold its 32-bit handle, so equal values compare as equal handles. Entries
+// are never freed; handle 0 is the empty string.
+class StringPool
+{
+    static StringPool *instance;
+    static const size_t chunkBits = 12, chunkSize = (size_t)1 << chunkBits, maxChunks = 4096;
+    static const size_t arenaSize = 64 * 1024;
+
+    // Handle -> string through fixed chunks that never move, so lookups
+    // need no lock; only interning a new value takes the mutex
+    unique_ptr<const char *[]> chunks[maxChunks];
+    unordered_map<string_view, uint32_t> handles;
+    vector<unique_ptr<char[]>> arenas;
+    char *arena = nullptr;
+    size_t arenaUsed = arenaSize, stringBytes = 0;
+    uint32_t count = 0;
+    mutex lock;
+
+    StringPool() { store(""); }
+
+    // Caller holds lock
+    uint32_t store(const char *text)
+    {
+        size_t length = strlen(text) + 1;
+        char *copy;
+        if (length > arenaSize / 4)
+        {
+            arenas.emplace_back(new char[length]);
+            copy = arenas.back().get();
+        }
+        else
+        {
+            if (arenaUsed + length > arenaSize)
+            {
+                arenas.emplace_back(new char[arenaSize]);
+                arena = arenas.back().get();
+                arenaUsed = 0;
+            }
+            copy = arena + arenaUsed;
+            arenaUsed += length;
+        }
+        memcpy(copy, text, length);
+        stringBytes += length;
+
+        uint32_t handle = count;
+        if (!chunks[handle >> chunkBits])
+            chunks[handle >> chunkBits].reset(new const char *[chunkSize]);
+        chunks[handle >> chunkBits][handle & (chunkSize - 1)] = copy;
+        handles.emplace(string_view(copy, length - 1), handle);
+        count++;
+        return handle;
+    }
+
+public:
+    static StringPool *getInstance()
+    {
+        if (!instance)
+            instance = new StringPool();
+        return instance;
+    }
+
+    uint32_t intern(const char *text)
+    {
+        if (!*text)
+            return 0;
+        lock_guard<mutex> guard(lock);
+        auto it = handles.find(string_view(text));
+        if (it != handles.end())
+            return it->second;
+        if (count >= chunkSize * maxChunks)
+            throw HospitalException("String pool is full");
+        return store(text);
+    }
+
+    // Finds an existing handle without adding the value; a filter on a value
+    // nobody has can stop without looking at a single record
+    bool lookup(const char *text, uint32_t &handle)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = handles.find(string_view(text));
+        if (it == handles.end())
+            return false;
+        handle = it->second;
+        return true;
+    }
+
+    const char *get(uint32_t handle) const { return chunks[handle >> chunkBits][handle & (chunkSize - 1)]; }
+
+    void report(size_t &distinct, size_t &bytes)
+    {
+        lock_guard<mutex> guard(lock);
+        distinct = count;
+        bytes = stringBytes;
+    }
+};
+
+StringPool *StringPool::instance = nullptr;
+
 class MenuStrategy
 {
 public:
     virtual void displayMenu() = 0;
     virtual void handleChoice(int) = 0;
-    virtual ~MenuStrategy() {}
+    // The strategies add no state of their own, so the base size is the object size
+    MenuStrategy() { MemoryAccounting::allocated(MEM_MENUS, sizeof(MenuStrategy)); }
+    virtual ~MenuStrategy() { MemoryAccounting::freed(MEM_MENUS, sizeof(MenuStrategy)); }
+
+protected:
+    // Returns 0 when the user enters 0, which the prompt says will onZero
+    static int promptPatientId(const char *purpose, const char *onZero = "cancel")
+    {
+        while (true)
+        {
+            cout << "\nEnter patient ID to " << purpose << " (0 to " << onZero << "): ";
+            string idStr;
+            getline(cin, idStr);
+
+            Validated<int> parsed = InputValidator::parseNumber(idStr, 0, INT_MAX);
+            if (parsed.ok())
+                return parsed.value;
+            if (parsed.error == InputError::TooLarge)
+                cout << "ID value is too large! Please enter a smaller number.";
+            else
+                cout << "Invalid input!";
+        }
+    }
 };
 
 class Patient
 {
     int id;
-    char *name, *address, *contactNumber, *diagnosis;
+    char *name, *contactNumber;
+    // Handles into StringPool; many patients share these values
+    uint32_t addressId, diagnosisId;
     int age;
     char gender;
+    // Bumped by FileHandler on every committed change; updates must carry
+    // the version they were read at
+    uint32_t version = 0;
 
 public:
     Patient(int id = 0, const char *name = "", int age = 0, char gender = '\0', const char *address = "", const char *contactNumber = "", const char *diagnosis = "")
         : id(id), age(age), gender(gender)
     {
-        this->name = new char[strlen(name) + 1];
-        strcpy(this->name, name);
-        this->address = new char[strlen(address) + 1];
-        strcpy(this->address, address);
-        this->contactNumber = new char[strlen(contactNumber) + 1];
-        strcpy(this->contactNumber, contactNumber);
-        this->diagnosis = new char[strlen(diagnosis) + 1];
-        strcpy(this->diagnosis, diagnosis);
+        this->name = MemoryAccounting::copyString(MEM_PATIENT_RECORDS, name);
+        addressId = StringPool::getInstance()->intern(address);
+        this->contactNumber = MemoryAccounting::copyString(MEM_PATIENT_RECORDS, contactNumber);
+        diagnosisId = StringPool::getInstance()->intern(diagnosis);
+    }
+
+    Patient(const Patient &other) : id(other.id), addressId(other.addressId), diagnosisId(other.diagnosisId),
+                                    age(other.age), gender(other.gender), version(other.version)
+    {
+        name = MemoryAccounting::copyString(MEM_PATIENT_RECORDS, other.name);
+        contactNumber = MemoryAccounting::copyString(MEM_PATIENT_RECORDS, other.contactNumber);
     }
 
-    Patient(const Patient &other) : Patient(other.id, other.name, other.age, other.gender, other.address, other.contactNumber, other.diagnosis) {}
+    Patient &operator=(const Patient &other)
+    {
+        if (this != &other)
+        {
+            id = other.id;
+            age = other.age;
+            gender = other.gender;
+            version = other.version;
+            addressId = other.addressId;
+            diagnosisId = other.diagnosisId;
+            setName(other.name);
+            setContactNumber(other.contactNumber);
+        }
+        return *this;
+    }
 
     ~Patient()
     {
-        delete[] name;
-        delete[] address;
-        delete[] contactNumber;
-        delete[] diagnosis;
+        MemoryAccounting::freeString(MEM_PATIENT_RECORDS, name);
+        MemoryAccounting::freeString(MEM_PATIENT_RECORDS, contactNumber);
     }
 
     int getId() const { return id; }
     const char *getName() const { return name; }
     int getAge() const { return age; }
     char getGender() const { return gender; }
-    const char *getAddress() const { return address; }
+    const char *getAddress() const { return StringPool::getInstance()->get(addressId); }
     const char *getContactNumber() const { return contactNumber; }
-    const char *getDiagnosis() const { return diagnosis; }
+    const char *getDiagnosis() const { return StringPool::getInstance()->get(diagnosisId); }
+    uint32_t getAddressId() const { return addressId; }
+    uint32_t getDiagnosisId() const { return diagnosisId; }
+    uint32_t getVersion() const { return version; }
 
     void setId(int id) { this->id = id; }
     void setAge(int age) { this->age = age; }
     void setGender(char gender) { this->gender = gender; }
+    void setVersion(uint32_t version) { this->version = version; }
 
     void setName(const char *name)
     {
-        delete[] this->name;
-        this->name = new char[strlen(name) + 1];
-        strcpy(this->name, name);
-    }
-    void setAddress(const char *address)
-    {
-        delete[] this->address;
-        this->address = new char[strlen(address) + 1];
-        strcpy(this->address, address);
+        char *copy = MemoryAccounting::copyString(MEM_PATIENT_RECORDS, name);
+        MemoryAccounting::freeString(MEM_PATIENT_RECORDS, this->name);
+        this->name = copy;
     }
+    void setAddress(const char *address) { addressId = StringPool::getInstance()->intern(address); }
     void setContactNumber(const char *contactNumber)
     {
-        delete[] this->contactNumber;
-        this->contactNumber = new char[strlen(contactNumber) + 1];
-        strcpy(this->contactNumber, contactNumber);
-    }
-    void setDiagnosis(const char *diagnosis)
-    {
-        delete[] this->diagnosis;
-        this->diagnosis = new char[strlen(diagnosis) + 1];
-        strcpy(this->diagnosis, diagnosis);
-    }
-
-    void display() const
-    {
-        cout << "Patient ID: " << id << "\nName: " << name << "\nAge: " << age << "\nGender: " << gender
-             << "\nAddress: " << address << "\nContact: " << contactNumber << "\nDiagnosis: "
-             << (strlen(diagnosis) ? diagnosis : "No diagnosis") << endl;
+        char *copy = MemoryAccounting::copyString(MEM_PATIENT_RECORDS, contactNumber);
+        MemoryAccounting::freeString(MEM_PATIENT_RECORDS, this->contactNumber);
+        this->contactNumber = copy;
     }
+    void setDiagnosis(const char *diagnosis) { diagnosisId = StringPool::getInstance()->intern(diagnosis); }
 
+    void display() const;
     void displayShort() const { cout << "ID: " << id << " - Name: " << name << endl; }
 
-    string toString() const
-    {
-        return to_string(id) + "|" + name + "|" + to_string(age) + "|" + gender + "|" + address + "|" + contactNumber + "|" + diagnosis;
-    }
+    // Both follow PatientSchema, below
+    string toString() const;
+    // Throws invalid_argument when the record does not parse
+    void fromString(const string &str);
+};
 
-    void fromString(const string &str)
-    {
-        stringstream ss(str);
-        string token;
+// Patient's fields, in record order. Each descriptor names its field, says
+// how to get and set it and, if it is typed in at registration, how to
+// check it. The value type picks the code PatientSchema generates, so a
+// new field is one descriptor here plus its entry in the list below.
+struct FieldDefaults
+{
+    static constexpr const char *prompt = nullptr;    // not asked for at registration
+    static constexpr const char *emptyText = nullptr; // shown instead of an empty value
+};
 
-        getline(ss, token, '|');
-        id = stoi(token);
-        getline(ss, token, '|');
-        setName(token.c_str());
-        getline(ss, token, '|');
-        age = stoi(token);
-        getline(ss, token, '|');
-        gender = token[0];
-        getline(ss, token, '|');
-        setAddress(token.c_str());
-        getline(ss, token, '|');
-        setContactNumber(token.c_str());
-        getline(ss, token);
-        setDiagnosis(token.c_str());
-    }
+struct PatientIdField : FieldDefaults
+{
+    static constexpr const char *key = "id", *label = "Patient ID";
+    static int get(const Patient &p) { return p.getId(); }
+    static void set(Patient &p, int value) { p.setId(value); }
 };
 
-class User
+struct PatientNameField : FieldDefaults
 {
-protected:
-    char *username, *password;
+    static constexpr const char *key = "name", *label = "Name", *prompt = "Name";
+    static const char *get(const Patient &p) { return p.getName(); }
+    static void set(Patient &p, const char *value) { p.setName(value); }
+    static InputError check(const string &input) { return InputValidator::checkName(input); }
+};
 
-public:
-    User(const char *username, const char *password)
-    {
-        this->username = new char[strlen(username) + 1];
-        strcpy(this->username, username);
-        this->password = new char[strlen(password) + 1];
-        strcpy(this->password, password);
-    }
+struct PatientAgeField : FieldDefaults
+{
+    static constexpr const char *key = "age", *label = "Age", *prompt = "Age";
+    static int get(const Patient &p) { return p.getAge(); }
+    static void set(Patient &p, int value) { p.setAge(value); }
+    static Validated<int> parse(const string &input) { return InputValidator::parseAge(input); }
+};
 
-    virtual ~User()
-    {
-        delete[] username;
-        delete[] password;
-    }
-    const char *getUsername() const { return username; }
-    bool authenticate(const char *pwd) const { return strcmp(password, pwd) == 0; }
-    virtual MenuStrategy *createMenuStrategy() = 0;
+struct PatientGenderField : FieldDefaults
+{
+    static constexpr const char *key = "gender", *label = "Gender", *prompt = "Gender (M/F/O)";
+    static char get(const Patient &p) { return p.getGender(); }
+    static void set(Patient &p, char value) { p.setGender(value); }
+    static Validated<char> parse(const string &input) { return InputValidator::parseGender(input); }
 };
 
-class FileHandler
+struct PatientAddressField : FieldDefaults
 {
-    static FileHandler *instance;
-    const char *patientFile = "patients.txt", *accessRightsFile = "access_rights.txt";
+    static constexpr const char *key = "address", *label = "Address", *prompt = "Address";
+    static const char *get(const Patient &p) { return p.getAddress(); }
+    static void set(Patient &p, const char *value) { p.setAddress(value); }
+    static InputError check(const string &input) { return InputValidator::checkAddress(input); }
+};
 
-    FileHandler()
-    {
-        ifstream file(accessRightsFile);
-        if (!file.good())
-            initializeAccessRights();
-    }
+struct PatientContactField : FieldDefaults
+{
+    static constexpr const char *key = "contact", *label = "Contact", *prompt = "Contact";
+    static const char *get(const Patient &p) { return p.getContactNumber(); }
+    static void set(Patient &p, const char *value) { p.setContactNumber(value); }
+    static InputError check(const string &input) { return InputValidator::checkContact(input); }
+};
 
-    void initializeAccessRights()
-    {
-        ofstream file(accessRightsFile);
-        if (!file)
-            throw FileOperationException("Could not create access rights file");
-        file << "Doctor|1|1|1\nReceptionist|1|1\n";
-    }
+// Last in the record, so it is the one field that may itself contain '|'
+struct PatientDiagnosisField : FieldDefaults
+{
+    static constexpr const char *key = "diagnosis", *label = "Diagnosis", *emptyText = "No diagnosis";
+    static const char *get(const Patient &p) { return p.getDiagnosis(); }
+    static void set(Patient &p, const char *value) { p.setDiagnosis(value); }
+};
 
-public:
-    static FileHandler *getInstance()
-    {
-        if (!instance)
-            instance = new FileHandler();
-        return instance;
-    }
+// Record format, registration prompts and display for Patient, expanded at
+// compile time from the field list: each field's code is picked by its
+// value type (int, char or text) and inlined, with no per-field dispatch.
+template <typename... Fields>
+class RecordSchema
+{
+    template <typename Field>
+    using ValueOf = decltype(Field::get(declval<const Patient &>()));
 
-    void savePatient(const Patient &p)
+    template <typename Field>
+    static void append(string &out, const Patient &p)
     {
-        ofstream file(patientFile, ios::app);
-        if (!file)
-            throw FileOperationException("Could not open patient file");
-        file << p.toString() << endl;
+        if constexpr (is_same<ValueOf<Field>, int>::value)
+        {
+            char digits[16];
+            out.append(digits, to_chars(digits, digits + sizeof digits, Field::get(p)).ptr);
+        }
+        else if constexpr (is_same<ValueOf<Field>, char>::value)
+            out += Field::get(p);
+        else
+            out += Field::get(p);
     }
 
-    void updatePatient(const Patient &p)
+    // Checks one field's text and, when p is given, stores it
+    template <typename Field>
+    static bool read(string_view text, Patient *p, string &scratch)
     {
-        Patient *patients;
-        int count;
-        loadAllPatients(patients, count);
-
-        bool found = false;
-        for (int i = 0; i < count; i++)
+        if constexpr (is_same<ValueOf<Field>, int>::value)
         {
-            if (patients[i].getId() == p.getId())
-            {
-                patients[i] = p;
-                found = true;
-                break;
-            }
+            int value;
+            auto result = from_chars(text.data(), text.data() + text.size(), value);
+            if (text.empty() || !isdigit((unsigned char)text[0]) || result.ec != errc() || result.ptr != text.data() + text.size())
+                return false;
+            if (p)
+                Field::set(*p, value);
         }
-
-        if (!found)
+        else if constexpr (is_same<ValueOf<Field>, char>::value)
         {
-            delete[] patients;
-            throw PatientNotFoundException();
+            if (text.size() != 1)
+                return false;
+            if (p)
+                Field::set(*p, text[0]);
         }
-
-        ofstream file(patientFile);
-        if (!file)
+        else if (p)
         {
-            delete[] patients;
-            throw FileOperationException("Could not open patient file");
+            scratch.assign(text.data(), text.size());
+            Field::set(*p, scratch.c_str());
         }
-
-        for (int i = 0; i < count; i++)
-            file << patients[i].toString() << endl;
-        delete[] patients;
+        return true;
     }
 
-    void deletePatient(int id)
+    // Validates typed input for one field and stores it
+    template <typename Field>
+    static InputError enter(Patient &p, const string &input)
     {
-        Patient *patients;
-        int count;
-        loadAllPatients(patients, count);
-
-        bool found = false;
-        for (int i = 0; i < count; i++)
+        if constexpr (is_same<ValueOf<Field>, const char *>::value)
         {
-            if (patients[i].getId() == id)
-            {
-                found = true;
-                break;
-            }
+            InputError error = Field::check(input);
+            if (error == InputError::None)
+                Field::set(p, input.c_str());
+            return error;
         }
-
-        if (!found)
+        else
         {
-            delete[] patients;
-            throw PatientNotFoundException();
+            auto parsed = Field::parse(input);
+            if (parsed.ok())
+                Field::set(p, parsed.value);
+            return parsed.error;
         }
+    }
 
-        ofstream file(patientFile);
-        if (!file)
-        {
-            delete[] patients;
-            throw FileOperationException("Could not open patient file");
-        }
+    static bool walk(string_view record, Patient *p)
+    {
+        string scratch;
+        size_t index = 0, pos = 0;
+        bool ok = true;
+        // All but the last field end at the next '|'; the last takes the rest
+        ((ok = ok && [&]
+          {
+              size_t end = ++index == sizeof...(Fields) ? record.size() : record.find('|', pos);
+              if (end == string_view::npos)
+                  return false;
+              bool fieldOk = read<Fields>(record.substr(pos, end - pos), p, scratch);
+              pos = end + 1;
+              return fieldOk; }()),
+         ...);
+        return ok;
+    }
 
-        for (int i = 0; i < count; i++)
-            if (patients[i].getId() != id)
-                file << patients[i].toString() << endl;
+public:
+    static constexpr int enteredCount = ((Fields::prompt != nullptr) + ...);
 
-        delete[] patients;
-    }
+    // Calls visit(Field{}) for each field in record order
+    template <typename Visitor>
+    static void forEach(Visitor visit) { (visit(Fields{}), ...); }
 
-    Patient getPatient(int id)
-    {
-        ifstream file(patientFile);
-        if (!file)
-            throw FileOperationException("Could not open patient file");
+    template <typename Field>
+    static constexpr bool isInteger() { return is_same<ValueOf<Field>, int>::value; }
 
-        string line;
-        while (getline(file, line))
-        {
-            if (line.empty())
-                continue;
-            Patient p;
-            p.fromString(line);
-            if (p.getId() == id)
-                return p;
-        }
+    template <typename Field>
+    static void appendValue(string &out, const Patient &p) { append<Field>(out, p); }
 
-        throw PatientNotFoundException();
+    // Fields joined by '|'
+    static string serialize(const Patient &p)
+    {
+        string out;
+        out.reserve(96);
+        bool first = true;
+        ((first ? (void)(first = false) : (void)(out += '|'), append<Fields>(out, p)), ...);
+        return out;
     }
 
-    void loadAllPatients(Patient *&patients, int &count)
-    {
-        ifstream file(patientFile);
-        count = 0;
+    // Returns false, leaving p partly assigned, if the record is malformed
+    static bool parse(string_view record, Patient &p) { return walk(record, &p); }
 
-        if (!file)
-        {
-            patients = new Patient[0];
-            return;
-        }
+    static bool wellFormed(string_view record) { return walk(record, nullptr); }
 
-        string line;
-        while (getline(file, line))
-            if (!line.empty())
-                count++;
-        file.clear();
-        file.seekg(0);
+    static void render(ostream &out, const Patient &p)
+    {
+        string value;
+        forEach([&](auto field)
+                {
+            using Field = decltype(field);
+            value.clear();
+            append<Field>(value, p);
+            out << Field::label << ": " << (value.empty() && Field::emptyText ? Field::emptyText : value.c_str()) << "\n"; });
+        out.flush();
+    }
 
-        patients = new Patient[count];
-        for (int i = 0; i < count && getline(file, line); i++)
-            if (!line.empty())
-                patients[i].fromString(line);
+    // Asks for every registration field in turn until each one is valid
+    static void prompt(Patient &p)
+    {
+        forEach([&](auto field)
+                {
+            using Field = decltype(field);
+            if constexpr (Field::prompt != nullptr)
+            {
+                string input;
+                while (true)
+                {
+                    cout << Field::prompt << ": ";
+                    getline(cin, input);
+                    if (enter<Field>(p, input) == InputError::None)
+                        break;
+                    cout << "Invalid input!\n";
+                }
+            } });
     }
 
-    int getNextPatientId()
+    // Registration fields from inputs, in order; returns the first error
+    static InputError fill(Patient &p, const vector<string> &inputs)
     {
-        Patient *patients;
-        int count, maxId = 0;
-        loadAllPatients(patients, count);
+        if ((int)inputs.size() != enteredCount)
+            return InputError::Empty;
+        InputError error = InputError::None;
+        size_t next = 0;
+        forEach([&](auto field)
+                {
+            using Field = decltype(field);
+            if constexpr (Field::prompt != nullptr)
+            {
+                const string &input = inputs[next++];
+                if (error == InputError::None)
+                    error = enter<Field>(p, input);
+            } });
+        return error;
+    }
+};
 
-        for (int i = 0; i < count; i++)
-            if (patients[i].getId() > maxId)
-                maxId = patients[i].getId();
+using PatientSchema = RecordSchema<PatientIdField, PatientNameField, PatientAgeField, PatientGenderField,
+                                   PatientAddressField, PatientContactField, PatientDiagnosisField>;
 
-        delete[] patients;
-        return maxId + 1;
-    }
+string Patient::toString() const { return PatientSchema::serialize(*this); }
 
-    bool *getAccessRights(const char *role, int &count)
-    {
-        ifstream file(accessRightsFile);
-        if (!file)
-            throw FileOperationException("Could not open access rights file");
+void Patient::fromString(const string &str)
+{
+    if (!PatientSchema::parse(str, *this))
+        throw invalid_argument("Malformed patient record");
+}
 
-        string line;
-        while (getline(file, line))
+void Patient::display() const { PatientSchema::render(cout, *this); }
+
+// Every line of patients.txt is stored as "<crc32c in hex>:<version>:<record>"
+// so torn writes and hand edits are caught on load, with the checksum covering
+// the version too. Lines without the prefix predate checksums and are accepted
+// as long as they parse; those and "<crc>:<record>" lines have version 0.
+class RecordChecksum
+{
+    struct Table
+    {
+        uint32_t entries[256];
+        Table()
         {
-            if (line.find(role) == 0)
+            for (uint32_t i = 0; i < 256; i++)
             {
-                stringstream ss(line);
-                string token;
-                count = 0;
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; bit++)
+                    crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+                entries[i] = crc;
+            }
+        }
+    };
 
-                getline(ss, token, '|'); // Skip role
-                while (getline(ss, token, '|'))
-                    count++;
+    static uint32_t software(const char *data, size_t length)
+    {
+        static const Table table;
+        uint32_t crc = 0xFFFFFFFF;
+        while (length--)
+            crc = table.entries[(crc ^ (uint8_t)*data++) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
 
-                bool *rights = new bool[count];
-                ss.clear();
-                ss.seekg(0);
-                getline(ss, token, '|'); // Skip role
+#ifdef HMS_CRC32_INSTRUCTION
+    __attribute__((target("sse4.2"))) static uint32_t hardware(const char *data, size_t length)
+    {
+        uint64_t crc = 0xFFFFFFFF;
+        for (; length >= 8; data += 8, length -= 8)
+        {
+            uint64_t word;
+            memcpy(&word, data, sizeof word);
+            crc = _mm_crc32_u64(crc, word);
+        }
+        uint32_t tail = (uint32_t)crc;
+        while (length--)
+            tail = _mm_crc32_u8(tail, (uint8_t)*data++);
+        return ~tail;
+    }
+#endif
 
-                for (int i = 0; i < count; i++)
-                {
-                    getline(ss, token, '|');
-                    rights[i] = (token == "1");
-                }
+    static bool wellFormed(const string &record) { return PatientSchema::wellFormed(record); }
 
-                return rights;
-            }
-        }
+public:
+    enum State
+    {
+        Sealed,
+        Legacy,
+        Corrupt
+    };
 
-        throw FileOperationException("Role not found");
+    static uint32_t compute(const char *data, size_t length)
+    {
+#ifdef HMS_CRC32_INSTRUCTION
+        static const bool hasInstruction = __builtin_cpu_supports("sse4.2");
+        if (hasInstruction)
+            return hardware(data, length);
+#endif
+        return software(data, length);
     }
 
-    void updateAccessRights(const char *role, const bool *rights, int count)
+    static string seal(const string &record, uint32_t version)
     {
-        ifstream inFile(accessRightsFile);
-        if (!inFile)
-            throw FileOperationException("Could not open access rights file");
+        string body = to_string(version) + ":" + record;
+        char prefix[10];
+        snprintf(prefix, sizeof prefix, "%08x:", compute(body.data(), body.size()));
+        return prefix + body;
+    }
 
-        string content, line;
-        bool found = false;
+    // Strips and checks the checksum and, if given, hands back the version;
+    // Corrupt also covers records that would not parse
+    static State open(const string &line, string &record, uint32_t *version = nullptr)
+    {
+        size_t end = line.size();
+        if (end && line[end - 1] == '\r')
+            end--;
 
-        while (getline(inFile, line))
+        uint32_t stored = 0;
+        bool sealed = end > 9 && line[8] == ':';
+        for (size_t i = 0; sealed && i < 8; i++)
         {
-            if (line.find(role) == 0)
-            {
-                found = true;
-                line = role;
-                for (int i = 0; i < count; i++)
-                    line += "|" + string(rights[i] ? "1" : "0");
-            }
-            content += line + "\n";
+            char c = (char)tolower((unsigned char)line[i]);
+            if (isdigit((unsigned char)c))
+                stored = stored << 4 | (uint32_t)(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                stored = stored << 4 | (uint32_t)(c - 'a' + 10);
+            else
+                sealed = false;
         }
 
-        if (!found)
-            throw FileOperationException("Role not found");
+        size_t start = sealed ? 9 : 0;
+        if (sealed && stored != compute(line.data() + start, end - start))
+            return Corrupt;
 
-        ofstream outFile(accessRightsFile);
-        if (!outFile)
-            throw FileOperationException("Could not open access rights file");
-        outFile << content;
+        // A record starts with its id and a '|', so digits then ':' is a version
+        uint32_t stamp = 0;
+        size_t digits = start;
+        while (sealed && digits < end && isdigit((unsigned char)line[digits]))
+            digits++;
+        if (sealed && digits > start && digits < end && line[digits] == ':')
+        {
+            auto result = from_chars(line.data() + start, line.data() + digits, stamp);
+            if (result.ec != errc())
+                return Corrupt;
+            start = digits + 1;
+        }
+        if (version)
+            *version = stamp;
+
+        record.assign(line, start, end - start);
+        if (!wellFormed(record))
+            return Corrupt;
+        return sealed ? Sealed : Legacy;
     }
 };
 
-FileHandler *FileHandler::instance = nullptr;
-
-class AdminMenuStrategy : public MenuStrategy
+// LZ77-style codec for patient archive blocks. Each sequence is a varint
+// literal count, the literal bytes, a varint match length (0 ends the block)
+// and a 16-bit back-reference offset.
+class BlockCompressor
 {
-    void manageMenu(const char *role, int count)
+    static void putVarint(string &out, uint32_t value)
     {
-        FileHandler *fh = FileHandler::getInstance();
-        bool *rights = fh->getAccessRights(role, count);
-
-        cout << "\n"
-             << role << " Current Status\n--------------------------------\n";
-        for (int i = 0; i < count; i++)
-            cout << (i == 0 ? "View" : i == 1 ? (role == "Doctor" ? "Update" : "Register")
-                                              : "Delete")
-                 << " - " << (rights[i] ? "ENABLED" : "DISABLED") << endl;
-
-        bool newRights[count], changed = false;
-        copy(rights, rights + count, newRights);
+        while (value >= 0x80)
+        {
+            out += (char)((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        out += (char)value;
+    }
 
-        for (int i = 0; i < count; i++)
+    static bool getVarint(const string &in, size_t &pos, uint32_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7)
         {
-            string action = (i == 0 ? "view" : i == 1 ? (role == "Doctor" ? "update" : "register") : "delete");
-            
-            // Ask whether to enable or disable based on current state
-            if (rights[i]) {
-                cout << "Disable " << action << "? (Y/N): ";
-            } else {
-                cout << "Enable " << action << "? (Y/N): ";
-            }
-            
-            char c;
-            cin >> c;
-            cin.ignore();
-            
-            if (toupper(c) == 'Y') {
-                // If it's currently enabled, disable it, and vice versa
-                newRights[i] = !rights[i];
-                changed = true;
-            }
+            if (pos >= in.size())
+                return false;
+            uint8_t byte = (uint8_t)in[pos++];
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return true;
         }
+        return false;
+    }
 
-        if (changed)
+public:
+    static string compress(const string &in)
+    {
+        const int hashBits = 12;
+        vector<int> table(1 << hashBits, -1);
+        string out;
+        size_t anchor = 0, i = 0;
+
+        while (i + 4 <= in.size())
         {
-            cout << "Apply changes?(Y/N): ";
-            char c;
-            cin >> c;
-            cin.ignore();
-            if (toupper(c) == 'Y')
+            uint32_t word;
+            memcpy(&word, in.data() + i, 4);
+            uint32_t hash = (word * 2654435761u) >> (32 - hashBits);
+            int candidate = table[hash];
+            table[hash] = (int)i;
+
+            if (candidate >= 0 && i - candidate <= 0xFFFF && memcmp(in.data() + candidate, in.data() + i, 4) == 0)
             {
-                fh->updateAccessRights(role, newRights, count);
-                cout << "Changes applied!\n";
+                size_t length = 4;
+                while (i + length < in.size() && in[candidate + length] == in[i + length])
+                    length++;
+
+                putVarint(out, (uint32_t)(i - anchor));
+                out.append(in, anchor, i - anchor);
+                putVarint(out, (uint32_t)length);
+                uint16_t offset = (uint16_t)(i - candidate);
+                out += (char)(offset & 0xFF);
+                out += (char)(offset >> 8);
+                i += length;
+                anchor = i;
             }
             else
-                cout << "Changes discarded.\n";
+                i++;
         }
-        else
-            cout << "No changes applied!\n";
 
-        delete[] rights;
+        putVarint(out, (uint32_t)(in.size() - anchor));
+        out.append(in, anchor, string::npos);
+        putVarint(out, 0);
+        return out;
     }
 
-public:
-    void displayMenu() override
+    static bool decompress(const string &in, string &out, size_t rawSize)
     {
-        cout << "\n---Admin---\n1. Manage doctor's menu\n2. Manage receptionist's menu\n3. Back\nEnter your choice: ";
-    }
+        out.clear();
+        out.reserve(rawSize);
+        size_t pos = 0;
 
-    void handleChoice(int choice) override
-    {
-        if (choice == 1)
-            manageMenu("Doctor", 3);
-        else if (choice == 2)
-            manageMenu("Receptionist", 2);
+        while (true)
+        {
+            uint32_t literals, length;
+            if (!getVarint(in, pos, literals) || pos + literals > in.size())
+                return false;
+            out.append(in, pos, literals);
+            pos += literals;
+
+            if (!getVarint(in, pos, length))
+                return false;
+            if (!length)
+                return out.size() == rawSize;
+            if (pos + 2 > in.size())
+                return false;
+
+            size_t offset = (uint8_t)in[pos] | ((size_t)(uint8_t)in[pos + 1] << 8);
+            pos += 2;
+            if (!offset || offset > out.size())
+                return false;
+
+            // Byte by byte: matches may overlap the bytes they produce
+            size_t from = out.size() - offset;
+            for (uint32_t k = 0; k < length; k++)
+                out += out[from + k];
+        }
     }
 };
 
-class DoctorMenuStrategy : public MenuStrategy
+// Disk-resident B+tree mapping patient IDs to 32-bit values, one 4 KB page
+// per node, so a lookup costs one page read per level. Deletes leave leaves
+// underfull rather than rebalancing.
+class BPlusTreeIndex
 {
-    void viewPatientRecords()
+    static const uint32_t pageSize = 4096, magic = 0x42505431;
+    static const uint32_t capacity = 510;
+
+    // Leaves use values[] for payloads and next for the right sibling;
+    // inner nodes use values[] as children (count + 1 of them)
+    struct Page
     {
-        try
-        {
-            // Check permission
-            FileHandler *fh = FileHandler::getInstance();
-            int count;
-            bool *rights = fh->getAccessRights("Doctor", count);
+        uint32_t isLeaf, count, next;
+        int32_t keys[capacity];
+        uint32_t values[capacity];
+        char padding[pageSize - 12 - capacity * 8];
+    };
 
-            if (!rights[0])
-            {
-                delete[] rights;
-                throw PermissionDeniedException();
-            }
-            delete[] rights;
+    fstream file;
+    uint32_t root = 1, pageCount = 2;
 
-            Patient *patients;
-            fh->loadAllPatients(patients, count);
+    void readPage(uint32_t number, Page &page)
+    {
+        file.seekg((streamoff)number * pageSize);
+        if (!file.read((char *)&page, sizeof page))
+            throw FileOperationException("Patient index is corrupted");
+    }
 
-            if (!count)
-            {
-                cout << "No patients registered yet.\n";
-                return;
-            }
+    void writePage(uint32_t number, const Page &page)
+    {
+        file.seekp((streamoff)number * pageSize);
+        file.write((const char *)&page, sizeof page);
+    }
 
-            cout << "\nPatient List:\n";
-            for (int i = 0; i < count; i++)
-                patients[i].displayShort();
+    void writeHeader()
+    {
+        uint32_t header[3] = {magic, root, pageCount};
+        file.seekp(0);
+        file.write((const char *)header, sizeof header);
+        file.flush();
+    }
 
-            cout << "\nEnter patient ID to view details (0 to cancel): ";
-            int id;
-            cin >> id;
-            cin.ignore();
-            if (!id)
-            {
-                delete[] patients;
-                return;
-            }
+    // Returns true if the page split; splitKey/splitPage describe the new right half
+    bool insertInto(uint32_t number, int32_t key, uint32_t value, int32_t &splitKey, uint32_t &splitPage)
+    {
+        Page page;
+        readPage(number, page);
 
-            for (int i = 0; i < count; i++)
+        vector<int32_t> keys(page.keys, page.keys + page.count);
+        vector<uint32_t> values(page.values, page.values + page.count + (page.isLeaf ? 0 : 1));
+
+        if (page.isLeaf)
+        {
+            size_t pos = lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            if (pos < keys.size() && keys[pos] == key)
             {
-                if (patients[i].getId() == id)
-                {
-                    cout << "\nPatient Details:\n";
-                    patients[i].display();
-                    delete[] patients;
-                    return;
-                }
+                page.values[pos] = value;
+                writePage(number, page);
+                return false;
             }
+            keys.insert(keys.begin() + pos, key);
+            values.insert(values.begin() + pos, value);
+        }
+        else
+        {
+            size_t pos = upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+            int32_t childKey;
+            uint32_t childPage;
+            if (!insertInto(values[pos], key, value, childKey, childPage))
+                return false;
+            keys.insert(keys.begin() + pos, childKey);
+            values.insert(values.begin() + pos + 1, childPage);
+        }
 
-            cout << "Patient not found.\n";
-            delete[] patients;
+        size_t limit = page.isLeaf ? capacity : capacity - 1;
+        if (keys.size() <= limit)
+        {
+            page.count = (uint32_t)keys.size();
+            copy(keys.begin(), keys.end(), page.keys);
+            copy(values.begin(), values.end(), page.values);
+            writePage(number, page);
+            return false;
         }
-        catch (PermissionDeniedException &e)
+
+        Page right{};
+        right.isLeaf = page.isLeaf;
+        size_t mid = keys.size() / 2;
+        splitPage = pageCount++;
+        if (page.isLeaf)
         {
-            cout << e.what() << endl;
+            right.count = (uint32_t)(keys.size() - mid);
+            copy(keys.begin() + mid, keys.end(), right.keys);
+            copy(values.begin() + mid, values.end(), right.values);
+            right.next = page.next;
+            page.next = splitPage;
+            page.count = (uint32_t)mid;
+            splitKey = keys[mid];
+        }
+        else
+        {
+            // The middle key moves up; it separates the two halves
+            right.count = (uint32_t)(keys.size() - mid - 1);
+            copy(keys.begin() + mid + 1, keys.end(), right.keys);
+            copy(values.begin() + mid + 1, values.end(), right.values);
+            page.count = (uint32_t)mid;
+            splitKey = keys[mid];
         }
+        copy(keys.begin(), keys.begin() + page.count, page.keys);
+        copy(values.begin(), values.begin() + page.count + (page.isLeaf ? 0 : 1), page.values);
+        writePage(number, page);
+        writePage(splitPage, right);
+        return true;
     }
 
-    void updatePatientRecord()
+    uint32_t findLeaf(int32_t key, Page &page)
     {
-    try
-    {
-        // Check permission
-        FileHandler *fh = FileHandler::getInstance();
-        int count;
-        bool *rights = fh->getAccessRights("Doctor", count);
-
-        if (!rights[1])
+        uint32_t number = root;
+        readPage(number, page);
+        while (!page.isLeaf)
         {
-            delete[] rights;
-            throw PermissionDeniedException();
+            number = page.values[upper_bound(page.keys, page.keys + page.count, key) - page.keys];
+            readPage(number, page);
         }
-        delete[] rights;
+        return number;
+    }
 
-        Patient *patients;
+public:
+    // Returns false if there was no valid index at path and an empty one was
+    // created. An index that exists but is empty had every key erased.
+    bool open(const char *path)
+    {
+        file.open(path, ios::in | ios::out | ios::binary);
+        uint32_t header[3];
+        if (file && file.read((char *)header, sizeof header) && header[0] == magic)
+        {
+            root = header[1];
+            pageCount = header[2];
+            return true;
+        }
+
+        // New or unreadable index: start with an empty root leaf
+        file.close();
+        file.open(path, ios::in | ios::out | ios::binary | ios::trunc);
+        if (!file)
+            throw FileOperationException("Could not create patient index");
+        root = 1;
+        pageCount = 2;
+        Page empty{};
+        empty.isLeaf = 1;
+        writePage(0, empty);
+        writePage(root, empty);
+        writeHeader();
+        return false;
+    }
+
+    bool find(int32_t key, uint32_t &value)
+    {
+        Page page;
+        findLeaf(key, page);
+        int32_t *pos = lower_bound(page.keys, page.keys + page.count, key);
+        if (pos == page.keys + page.count || *pos != key)
+            return false;
+        value = page.values[pos - page.keys];
+        return true;
+    }
+
+    void insert(int32_t key, uint32_t value)
+    {
+        int32_t splitKey;
+        uint32_t splitPage;
+        if (insertInto(root, key, value, splitKey, splitPage))
+        {
+            Page newRoot{};
+            newRoot.count = 1;
+            newRoot.keys[0] = splitKey;
+            newRoot.values[0] = root;
+            newRoot.values[1] = splitPage;
+            root = pageCount++;
+            writePage(root, newRoot);
+        }
+        writeHeader();
+    }
+
+    bool erase(int32_t key)
+    {
+        Page page;
+        uint32_t number = findLeaf(key, page);
+        int32_t *pos = lower_bound(page.keys, page.keys + page.count, key);
+        if (pos == page.keys + page.count || *pos != key)
+            return false;
+
+        size_t i = pos - page.keys;
+        copy(page.keys + i + 1, page.keys + page.count, page.keys + i);
+        copy(page.values + i + 1, page.values + page.count, page.values + i);
+        page.count--;
+        writePage(number, page);
+        file.flush();
+        return true;
+    }
+
+    // Visits every key in order along the leaf chain
+    template <typename Visitor>
+    void forEachKey(Visitor visit)
+    {
+        Page page;
+        uint32_t number = findLeaf(INT32_MIN, page);
+        while (true)
+        {
+            for (uint32_t i = 0; i < page.count; i++)
+                visit(page.keys[i]);
+            if (!page.next)
+                return;
+            number = page.next;
+            readPage(number, page);
+        }
+    }
+};
+
+// Bloom filter over patient IDs: a negative answer is definite, so lookups
+// for IDs that were never stored skip the disk entirely
+class BloomFilter
+{
+    static const uint32_t hashes = 7;
+    vector<uint64_t> bits;
+
+    static uint64_t mix(uint64_t x)
+    {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+public:
+    // About 10 bits per expected key keeps false positives near 1%
+    void reset(size_t expectedKeys) { bits.assign(max((size_t)16, (expectedKeys * 10 + 63) / 64), 0); }
+
+    void add(int id)
+    {
+        uint64_t hash = mix((uint64_t)(uint32_t)id), size = bits.size() * 64;
+        uint64_t h1 = hash & 0xFFFFFFFF, h2 = (hash >> 32) | 1;
+        for (uint32_t i = 0; i < hashes; i++)
+        {
+            uint64_t bit = (h1 + i * h2) % size;
+            bits[bit / 64] |= 1ull << (bit % 64);
+        }
+    }
+
+    bool mightContain(int id) const
+    {
+        if (bits.empty())
+            return false;
+        uint64_t hash = mix((uint64_t)(uint32_t)id), size = bits.size() * 64;
+        uint64_t h1 = hash & 0xFFFFFFFF, h2 = (hash >> 32) | 1;
+        for (uint32_t i = 0; i < hashes; i++)
+        {
+            uint64_t bit = (h1 + i * h2) % size;
+            if (!(bits[bit / 64] & (1ull << (bit % 64))))
+                return false;
+        }
+        return true;
+    }
+
+    bool load(const char *path)
+    {
+        ifstream file(path, ios::binary | ios::ate);
+        if (!file || file.tellg() <= 0 || file.tellg() % 8)
+            return false;
+        bits.resize((size_t)file.tellg() / 8);
+        file.seekg(0);
+        return (bool)file.read((char *)bits.data(), (streamsize)(bits.size() * 8));
+    }
+
+    void save(const char *path) const
+    {
+        ofstream file(path, ios::binary | ios::trunc);
+        file.write((const char *)bits.data(), (streamsize)(bits.size() * 8));
+        if (!file)
+            throw FileOperationException("Could not write patient bloom filter");
+    }
+};
+
+// Multi-version patient registry. Every write creates a new version stamped
+// with a commit number, and a reader that pins a commit number sees exactly
+// the records live at that point however much is written while it reads.
+// Versions no pinned snapshot can see any more are reclaimed. Not locked
+// internally: FileHandler serializes access with its registryLock.
+class VersionedRegistry
+{
+    struct Version
+    {
+        long long begin, end;
+        shared_ptr<const Patient> patient;
+    };
+    static const long long live = LLONG_MAX;
+
+    map<int, vector<Version>> chains;
+    long long commit = 0;
+    size_t liveCount = 0;
+    multiset<long long> pinned;
+    set<int> stale; // IDs whose chains still hold superseded versions
+
+    static bool visible(const Version &v, long long snapshot) { return v.begin <= snapshot && snapshot < v.end; }
+
+    void prune(int id)
+    {
+        auto it = chains.find(id);
+        if (it == chains.end())
+            return;
+        long long oldest = pinned.empty() ? commit : *pinned.begin();
+        vector<Version> &chain = it->second;
+        chain.erase(remove_if(chain.begin(), chain.end(), [oldest](const Version &v)
+                              { return v.end <= oldest; }),
+                    chain.end());
+        if (chain.empty())
+        {
+            chains.erase(it);
+            stale.erase(id);
+        }
+        else if (chain.size() == 1 && chain.back().end == live)
+            stale.erase(id);
+    }
+
+public:
+    const Patient *find(int id) const
+    {
+        auto it = chains.find(id);
+        if (it == chains.end() || it->second.back().end != live)
+            return nullptr;
+        return it->second.back().patient.get();
+    }
+
+    size_t size() const { return liveCount; }
+
+    int maxId() const
+    {
+        for (auto it = chains.rbegin(); it != chains.rend(); ++it)
+            if (it->second.back().end == live)
+                return it->first;
+        return 0;
+    }
+
+    void put(const Patient &p)
+    {
+        vector<Version> &chain = chains[p.getId()];
+        long long version = ++commit;
+        if (!chain.empty() && chain.back().end == live)
+        {
+            chain.back().end = version;
+            stale.insert(p.getId());
+        }
+        else
+            liveCount++;
+        chain.push_back({version, live, make_shared<const Patient>(p)});
+        prune(p.getId());
+    }
+
+    bool erase(int id)
+    {
+        auto it = chains.find(id);
+        if (it == chains.end() || it->second.back().end != live)
+            return false;
+        it->second.back().end = ++commit;
+        liveCount--;
+        stale.insert(id);
+        prune(id);
+        return true;
+    }
+
+    void clear()
+    {
+        chains.clear();
+        stale.clear();
+        liveCount = 0;
+    }
+
+    // Live records in ID order
+    template <typename Visitor>
+    void forEach(Visitor visit) const
+    {
+        for (const auto &entry : chains)
+            if (entry.second.back().end == live)
+                visit(*entry.second.back().patient);
+    }
+
+    long long pin()
+    {
+        pinned.insert(commit);
+        return commit;
+    }
+
+    void unpin(long long snapshot)
+    {
+        pinned.erase(pinned.find(snapshot));
+        // Releasing the oldest snapshot may free versions only it could see
+        if (pinned.empty() || *pinned.begin() > snapshot)
+        {
+            vector<int> ids(stale.begin(), stale.end());
+            for (int id : ids)
+                prune(id);
+        }
+    }
+
+    // Appends up to limit records visible at snapshot, starting at fromId.
+    // Returns false at the end; otherwise fromId is where to resume.
+    bool read(long long snapshot, int &fromId, size_t limit, vector<Patient> &out) const
+    {
+        auto it = chains.lower_bound(fromId);
+        for (; it != chains.end() && limit; ++it)
+        {
+            for (auto v = it->second.rbegin(); v != it->second.rend(); ++v)
+            {
+                if (visible(*v, snapshot))
+                {
+                    out.push_back(*v->patient);
+                    limit--;
+                    break;
+                }
+            }
+        }
+        if (it == chains.end())
+            return false;
+        fromId = it->first;
+        return true;
+    }
+};
+
+// Finds records that are probably the same person entered twice. Records are
+// grouped into blocks by normalized phone number and by a Soundex key of the
+// name, and only records sharing a block are compared with a bit-parallel
+// (Myers) edit distance.
+class DuplicateDetector
+{
+    struct Keys
+    {
+        string phone, nameKey, name;
+        int age;
+        char gender;
+    };
+
+    static string normalizePhone(const char *contact)
+    {
+        string digits;
+        for (const char *c = contact; *c; c++)
+            if (isdigit((unsigned char)*c))
+                digits += *c;
+        // Compare local numbers regardless of country/area prefixes
+        return digits.size() > 10 ? digits.substr(digits.size() - 10) : digits;
+    }
+
+    static string soundex(const string &word)
+    {
+        static const char codes[] = "01230120022455012623010202";
+        string key;
+        char last = 0;
+        for (char c : word)
+        {
+            if (!isalpha((unsigned char)c))
+                continue;
+            c = (char)tolower((unsigned char)c);
+            char code = codes[c - 'a'];
+            if (key.empty())
+                key += (char)toupper((unsigned char)c);
+            else if (code != '0' && code != last)
+                key += code;
+            if (c != 'h' && c != 'w')
+                last = code;
+            if (key.size() == 4)
+                break;
+        }
+        key.resize(4, '0');
+        return key;
+    }
+
+    static Keys keysFor(const Patient &p)
+    {
+        Keys keys;
+        keys.phone = normalizePhone(p.getContactNumber());
+        keys.age = p.getAge();
+        keys.gender = p.getGender();
+        for (const char *c = p.getName(); *c; c++)
+            keys.name += (char)tolower((unsigned char)*c);
+
+        stringstream ss(keys.name);
+        string first, word, last;
+        ss >> first;
+        while (ss >> word)
+            last = word;
+        keys.nameKey = soundex(first) + soundex(last);
+        return keys;
+    }
+
+    // Levenshtein distance, bit-parallel over the shorter string when it
+    // fits in a 64-bit word, otherwise the classic dynamic program
+    static int editDistance(const string &a, const string &b)
+    {
+        const string &pattern = a.size() <= b.size() ? a : b, &text = a.size() <= b.size() ? b : a;
+        size_t m = pattern.size();
+        if (!m)
+            return (int)text.size();
+
+        if (m <= 64)
+        {
+            uint64_t peq[256] = {0};
+            for (size_t i = 0; i < m; i++)
+                peq[(uint8_t)pattern[i]] |= 1ull << i;
+
+            uint64_t pv = ~0ull, mv = 0, last = 1ull << (m - 1);
+            int score = (int)m;
+            for (char c : text)
+            {
+                uint64_t eq = peq[(uint8_t)c];
+                uint64_t xv = eq | mv;
+                uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+                uint64_t ph = mv | ~(xh | pv);
+                uint64_t mh = pv & xh;
+                if (ph & last)
+                    score++;
+                else if (mh & last)
+                    score--;
+                ph = (ph << 1) | 1;
+                mh <<= 1;
+                pv = mh | ~(xv | ph);
+                mv = ph & xv;
+            }
+            return score;
+        }
+
+        vector<int> row(m + 1);
+        for (size_t i = 0; i <= m; i++)
+            row[i] = (int)i;
+        for (size_t j = 1; j <= text.size(); j++)
+        {
+            int diagonal = row[0];
+            row[0] = (int)j;
+            for (size_t i = 1; i <= m; i++)
+            {
+                int above = row[i];
+                row[i] = min({row[i] + 1, row[i - 1] + 1, diagonal + (pattern[i - 1] != text[j - 1])});
+                diagonal = above;
+            }
+        }
+        return row[m];
+    }
+
+    static bool isDuplicate(const Keys &ka, const Keys &kb)
+    {
+        int nameLimit = max(1, (int)min(ka.name.size(), kb.name.size()) / 5);
+        if (editDistance(ka.name, kb.name) > nameLimit)
+            return false;
+        if (ka.phone == kb.phone)
+            return true;
+        // Otherwise need two of: contact off by one typo, same age, same gender
+        int agreements = (editDistance(ka.phone, kb.phone) <= 1) + (ka.age == kb.age) + (ka.gender == kb.gender);
+        return agreements >= 2;
+    }
+
+public:
+    // Blocks of a live set of records, kept current by its owner on every
+    // add and remove, so a registration is compared with its own blocks only
+    class Index
+    {
+        unordered_map<int, Keys> keys;
+        unordered_map<string, set<int>> phoneBlocks, nameBlocks;
+
+    public:
+        void add(const Patient &p)
+        {
+            remove(p.getId());
+            Keys &k = keys[p.getId()] = keysFor(p);
+            phoneBlocks[k.phone].insert(p.getId());
+            nameBlocks[k.nameKey].insert(p.getId());
+        }
+
+        void remove(int id)
+        {
+            auto it = keys.find(id);
+            if (it == keys.end())
+                return;
+            for (auto block : {make_pair(&phoneBlocks, &it->second.phone), make_pair(&nameBlocks, &it->second.nameKey)})
+            {
+                auto members = block.first->find(*block.second);
+                members->second.erase(id);
+                if (members->second.empty())
+                    block.first->erase(members);
+            }
+            keys.erase(it);
+        }
+
+        void clear()
+        {
+            keys.clear();
+            phoneBlocks.clear();
+            nameBlocks.clear();
+        }
+
+        // Registration hook: records that look like the candidate, in ID order
+        vector<int> findMatches(const Patient &candidate) const
+        {
+            Keys k = keysFor(candidate);
+            set<int> matches;
+            for (auto block : {make_pair(&phoneBlocks, &k.phone), make_pair(&nameBlocks, &k.nameKey)})
+            {
+                auto members = block.first->find(*block.second);
+                if (members == block.first->end())
+                    continue;
+                for (int id : members->second)
+                    if (id != candidate.getId() && isDuplicate(k, keys.at(id)))
+                        matches.insert(id);
+            }
+            return vector<int>(matches.begin(), matches.end());
+        }
+    };
+
+    // Whole-registry scan: blocks are handed out to one worker per core.
+    // Returns index pairs into patients, each pair once, sorted.
+    static vector<pair<int, int>> findAll(const Patient *patients, int count)
+    {
+        vector<Keys> keys(count);
+        unordered_map<string, vector<int>> phoneBlocks, nameBlocks;
+        for (int i = 0; i < count; i++)
+        {
+            keys[i] = keysFor(patients[i]);
+            phoneBlocks[keys[i].phone].push_back(i);
+            nameBlocks[keys[i].nameKey].push_back(i);
+        }
+
+        vector<const vector<int> *> blocks;
+        for (auto *index : {&phoneBlocks, &nameBlocks})
+            for (const auto &entry : *index)
+                if (entry.second.size() > 1)
+                    blocks.push_back(&entry.second);
+        // Largest blocks first so one big block doesn't finish last on its own
+        sort(blocks.begin(), blocks.end(), [](const vector<int> *a, const vector<int> *b)
+             { return a->size() > b->size(); });
+
+        unsigned workers = max(1u, thread::hardware_concurrency());
+        atomic<size_t> nextBlock{0};
+        vector<vector<pair<int, int>>> found(workers);
+        vector<thread> threads;
+        for (unsigned w = 0; w < workers; w++)
+        {
+            threads.emplace_back([&, w]
+                                 {
+                for (size_t b = nextBlock++; b < blocks.size(); b = nextBlock++)
+                {
+                    const vector<int> &block = *blocks[b];
+                    for (size_t i = 0; i < block.size(); i++)
+                        for (size_t j = i + 1; j < block.size(); j++)
+                            if (isDuplicate(keys[block[i]], keys[block[j]]))
+                                found[w].push_back({min(block[i], block[j]), max(block[i], block[j])});
+                } });
+        }
+        for (thread &t : threads)
+            t.join();
+
+        // A pair can share both a phone block and a name block
+        set<pair<int, int>> unique;
+        for (const auto &list : found)
+            unique.insert(list.begin(), list.end());
+        return vector<pair<int, int>>(unique.begin(), unique.end());
+    }
+};
+
+// The registry plus the duplicate blocks of its live records, kept in step
+// by every put, erase and clear
+class IndexedRegistry : public VersionedRegistry
+{
+    DuplicateDetector::Index duplicates;
+
+public:
+    void put(const Patient &p)
+    {
+        VersionedRegistry::put(p);
+        duplicates.add(p);
+    }
+
+    bool erase(int id)
+    {
+        duplicates.remove(id);
+        return VersionedRegistry::erase(id);
+    }
+
+    void clear()
+    {
+        VersionedRegistry::clear();
+        duplicates.clear();
+    }
+
+    vector<int> findDuplicates(const Patient &candidate) const { return duplicates.findMatches(candidate); }
+};
+
+struct TriageEntry
+{
+    int patientId;
+    int priority;
+    long long seq;
+};
+
+struct Prescription
+{
+    int id;
+    int patientId;
+    string drug, dosage;
+    time_t prescribedAt, endsAt;
+
+    bool isActive(time_t now) const { return now < endsAt; }
+
+    string toString() const
+    {
+        return to_string(id) + "|" + to_string(patientId) + "|" + drug + "|" + dosage + "|" +
+               to_string((long long)prescribedAt) + "|" + to_string((long long)endsAt);
+    }
+
+    // Returns false for a line that doesn't parse, such as one torn by a crash
+    bool fromString(const string &str)
+    {
+        stringstream ss(str);
+        string idText, patientText, prescribedText, endsText;
+        long long prescribed, ends;
+        if (!getline(ss, idText, '|') || !getline(ss, patientText, '|') || !getline(ss, drug, '|') ||
+            !getline(ss, dosage, '|') || !getline(ss, prescribedText, '|') || !getline(ss, endsText))
+            return false;
+        if (!parseInteger(idText, id) || !parseInteger(patientText, patientId) ||
+            !parseInteger(prescribedText, prescribed) || !parseInteger(endsText, ends))
+            return false;
+        prescribedAt = (time_t)prescribed;
+        endsAt = (time_t)ends;
+        return true;
+    }
+
+private:
+    template <typename T>
+    static bool parseInteger(const string &text, T &value)
+    {
+        auto result = from_chars(text.data(), text.data() + text.size(), value);
+        return !text.empty() && result.ec == errc() && result.ptr == text.data() + text.size();
+    }
+};
+
+enum BedType
+{
+    BED_GENERAL,
+    BED_ICU,
+    BED_MATERNITY,
+    BED_PEDIATRIC,
+    BED_ISOLATION,
+    BED_TYPE_COUNT
+};
+
+constexpr const char *bedTypeNames[BED_TYPE_COUNT] = {"General", "ICU", "Maternity", "Pediatric", "Isolation"};
+
+// A block of beds of one type in a ward. A ward may take several blocks; its
+// beds are numbered from 1 across them in order.
+struct WardLayout
+{
+    string ward;
+    BedType type;
+    int beds;
+};
+
+// One occupancy change; patientId 0 frees the bed
+struct BedAssignment
+{
+    string ward;
+    int bed;
+    int patientId;
+};
+
+const WardLayout defaultWardLayout[] = {{"General", BED_GENERAL, 48}, {"General", BED_ISOLATION, 4},
+                                        {"ICU", BED_ICU, 12}, {"Maternity", BED_MATERNITY, 20},
+                                        {"Pediatrics", BED_PEDIATRIC, 24}, {"Pediatrics", BED_ISOLATION, 2}};
+constexpr int defaultWardLayoutCount = sizeof defaultWardLayout / sizeof defaultWardLayout[0];
+
+enum InteractionSeverity
+{
+    INTERACTION_MINOR = 1,
+    INTERACTION_MODERATE,
+    INTERACTION_MAJOR
+};
+
+struct DrugInteraction
+{
+    const char *first, *second; // lowercase generic names
+    InteractionSeverity severity;
+    const char *effect;
+};
+
+constexpr DrugInteraction drugInteractions[] = {
+    {"warfarin", "aspirin", INTERACTION_MAJOR, "increased bleeding risk"},
+    {"warfarin", "ibuprofen", INTERACTION_MAJOR, "increased bleeding risk"},
+    {"warfarin", "naproxen", INTERACTION_MAJOR, "increased bleeding risk"},
+    {"warfarin", "amiodarone", INTERACTION_MAJOR, "raised INR"},
+    {"warfarin", "fluconazole", INTERACTION_MAJOR, "raised INR"},
+    {"warfarin", "metronidazole", INTERACTION_MAJOR, "raised INR"},
+    {"warfarin", "ciprofloxacin", INTERACTION_MODERATE, "raised INR"},
+    {"warfarin", "clarithromycin", INTERACTION_MODERATE, "raised INR"},
+    {"clopidogrel", "omeprazole", INTERACTION_MODERATE, "reduced antiplatelet effect"},
+    {"clopidogrel", "aspirin", INTERACTION_MODERATE, "increased bleeding risk"},
+    {"simvastatin", "clarithromycin", INTERACTION_MAJOR, "myopathy and rhabdomyolysis"},
+    {"simvastatin", "ketoconazole", INTERACTION_MAJOR, "myopathy and rhabdomyolysis"},
+    {"simvastatin", "amiodarone", INTERACTION_MODERATE, "myopathy"},
+    {"simvastatin", "amlodipine", INTERACTION_MODERATE, "myopathy"},
+    {"atorvastatin", "clarithromycin", INTERACTION_MODERATE, "myopathy"},
+    {"sildenafil", "nitroglycerin", INTERACTION_MAJOR, "severe hypotension"},
+    {"sildenafil", "isosorbide mononitrate", INTERACTION_MAJOR, "severe hypotension"},
+    {"lisinopril", "spironolactone", INTERACTION_MAJOR, "hyperkalemia"},
+    {"lisinopril", "potassium chloride", INTERACTION_MAJOR, "hyperkalemia"},
+    {"lisinopril", "ibuprofen", INTERACTION_MODERATE, "reduced kidney function"},
+    {"losartan", "spironolactone", INTERACTION_MAJOR, "hyperkalemia"},
+    {"spironolactone", "potassium chloride", INTERACTION_MAJOR, "hyperkalemia"},
+    {"methotrexate", "trimethoprim", INTERACTION_MAJOR, "bone marrow suppression"},
+    {"methotrexate", "ibuprofen", INTERACTION_MODERATE, "methotrexate toxicity"},
+    {"fluoxetine", "tramadol", INTERACTION_MAJOR, "serotonin syndrome"},
+    {"sertraline", "tramadol", INTERACTION_MAJOR, "serotonin syndrome"},
+    {"fluoxetine", "phenelzine", INTERACTION_MAJOR, "serotonin syndrome"},
+    {"sertraline", "linezolid", INTERACTION_MAJOR, "serotonin syndrome"},
+    {"tamoxifen", "fluoxetine", INTERACTION_MODERATE, "reduced tamoxifen effect"},
+    {"digoxin", "amiodarone", INTERACTION_MAJOR, "digoxin toxicity"},
+    {"digoxin", "verapamil", INTERACTION_MAJOR, "digoxin toxicity"},
+    {"digoxin", "clarithromycin", INTERACTION_MODERATE, "digoxin toxicity"},
+    {"metoprolol", "verapamil", INTERACTION_MAJOR, "bradycardia and heart block"},
+    {"ciprofloxacin", "tizanidine", INTERACTION_MAJOR, "severe hypotension and sedation"},
+    {"ciprofloxacin", "theophylline", INTERACTION_MAJOR, "theophylline toxicity"},
+    {"ciprofloxacin", "calcium carbonate", INTERACTION_MINOR, "reduced antibiotic absorption"},
+    {"doxycycline", "calcium carbonate", INTERACTION_MINOR, "reduced antibiotic absorption"},
+    {"levothyroxine", "calcium carbonate", INTERACTION_MINOR, "reduced levothyroxine absorption"},
+    {"levothyroxine", "ferrous sulfate", INTERACTION_MINOR, "reduced levothyroxine absorption"},
+    {"lithium", "ibuprofen", INTERACTION_MAJOR, "lithium toxicity"},
+    {"lithium", "hydrochlorothiazide", INTERACTION_MAJOR, "lithium toxicity"},
+    {"lithium", "lisinopril", INTERACTION_MODERATE, "lithium toxicity"},
+    {"allopurinol", "azathioprine", INTERACTION_MAJOR, "bone marrow suppression"},
+    {"colchicine", "clarithromycin", INTERACTION_MAJOR, "colchicine toxicity"},
+    {"carbamazepine", "clarithromycin", INTERACTION_MAJOR, "carbamazepine toxicity"},
+    {"metformin", "iodinated contrast", INTERACTION_MODERATE, "lactic acidosis"},
+    {"prednisone", "ibuprofen", INTERACTION_MODERATE, "gastrointestinal bleeding"},
+    {"insulin", "metoprolol", INTERACTION_MINOR, "masked hypoglycemia"},
+};
+
+// Perfect hash over drugInteractions, built by the compiler: entries are
+// grouped into buckets by one hash, and each bucket gets the first seed
+// that sends all of its pairs to free slots. A lookup is two hashes and
+// one comparison, with nothing to parse or build at startup.
+class DrugInteractionTable
+{
+public:
+    static constexpr size_t entryCount = sizeof drugInteractions / sizeof drugInteractions[0];
+    static constexpr size_t bucketCount = entryCount / 4 + 1;
+    // Half-full table of a power-of-two size, so seeds are found quickly
+    static constexpr size_t slotCount = (size_t)1 << (64 - __builtin_clzll(2 * entryCount - 1));
+
+    struct Layout
+    {
+        uint32_t seeds[bucketCount];
+        int32_t slots[slotCount];
+    };
+
+    static constexpr char lower(char c) { return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c; }
+
+    // Case-insensitive; the pair is hashed in name order so it doesn't
+    // matter which drug comes first
+    static constexpr bool nameLess(const char *a, const char *b)
+    {
+        while (*a && lower(*a) == lower(*b))
+        {
+            a++;
+            b++;
+        }
+        return (uint8_t)lower(*a) < (uint8_t)lower(*b);
+    }
+
+    static constexpr bool nameEqual(const char *a, const char *b) { return !nameLess(a, b) && !nameLess(b, a); }
+
+    static constexpr uint32_t pairHash(const char *a, const char *b, uint32_t seed)
+    {
+        if (nameLess(b, a))
+        {
+            const char *swap = a;
+            a = b;
+            b = swap;
+        }
+        uint32_t hash = 2166136261u ^ (seed * 0x9E3779B9u);
+        for (; *a; a++)
+            hash = (hash ^ (uint8_t)lower(*a)) * 16777619u;
+        hash = (hash ^ 0xFF) * 16777619u;
+        for (; *b; b++)
+            hash = (hash ^ (uint8_t)lower(*b)) * 16777619u;
+        return hash ^ (hash >> 15);
+    }
+
+    static constexpr bool hasDuplicatePairs()
+    {
+        for (size_t i = 0; i < entryCount; i++)
+            for (size_t j = i + 1; j < entryCount; j++)
+            {
+                const DrugInteraction &x = drugInteractions[i], &y = drugInteractions[j];
+                if ((nameEqual(x.first, y.first) && nameEqual(x.second, y.second)) ||
+                    (nameEqual(x.first, y.second) && nameEqual(x.second, y.first)))
+                    return true;
+            }
+        return false;
+    }
+
+    static constexpr Layout build()
+    {
+        Layout layout{};
+        for (size_t i = 0; i < slotCount; i++)
+            layout.slots[i] = -1;
+
+        // Counting sort of the entries by bucket
+        size_t bucketStart[bucketCount + 1]{}, order[entryCount]{}, fill[bucketCount]{};
+        for (size_t i = 0; i < entryCount; i++)
+            bucketStart[pairHash(drugInteractions[i].first, drugInteractions[i].second, 0) % bucketCount + 1]++;
+        for (size_t b = 0; b < bucketCount; b++)
+            bucketStart[b + 1] += bucketStart[b];
+        for (size_t i = 0; i < entryCount; i++)
+        {
+            size_t b = pairHash(drugInteractions[i].first, drugInteractions[i].second, 0) % bucketCount;
+            order[bucketStart[b] + fill[b]++] = i;
+        }
+
+        // Place the biggest buckets first while the table is emptiest
+        bool placed[bucketCount]{};
+        for (size_t round = 0; round < bucketCount; round++)
+        {
+            size_t bucket = bucketCount;
+            for (size_t b = 0; b < bucketCount; b++)
+                if (!placed[b] && (bucket == bucketCount || bucketStart[b + 1] - bucketStart[b] > bucketStart[bucket + 1] - bucketStart[bucket]))
+                    bucket = b;
+            placed[bucket] = true;
+
+            for (uint32_t seed = 1;; seed++)
+            {
+                size_t used = bucketStart[bucket];
+                for (; used < bucketStart[bucket + 1]; used++)
+                {
+                    const DrugInteraction &entry = drugInteractions[order[used]];
+                    size_t slot = pairHash(entry.first, entry.second, seed) % slotCount;
+                    if (layout.slots[slot] != -1)
+                        break;
+                    layout.slots[slot] = (int32_t)order[used];
+                }
+                if (used == bucketStart[bucket + 1])
+                {
+                    layout.seeds[bucket] = seed;
+                    break;
+                }
+                for (size_t k = bucketStart[bucket]; k < used; k++)
+                {
+                    const DrugInteraction &entry = drugInteractions[order[k]];
+                    layout.slots[pairHash(entry.first, entry.second, seed) % slotCount] = -1;
+                }
+            }
+        }
+        return layout;
+    }
+
+    static const DrugInteraction *find(const char *a, const char *b);
+};
+
+static_assert(!DrugInteractionTable::hasDuplicatePairs(), "drugInteractions lists a pair twice");
+constexpr DrugInteractionTable::Layout drugInteractionLayout = DrugInteractionTable::build();
+
+inline const DrugInteraction *DrugInteractionTable::find(const char *a, const char *b)
+{
+    uint32_t seed = drugInteractionLayout.seeds[pairHash(a, b, 0) % bucketCount];
+    int32_t index = drugInteractionLayout.slots[pairHash(a, b, seed) % slotCount];
+    if (index < 0)
+        return nullptr;
+    const DrugInteraction &entry = drugInteractions[index];
+    bool match = (nameEqual(entry.first, a) && nameEqual(entry.second, b)) ||
+                 (nameEqual(entry.first, b) && nameEqual(entry.second, a));
+    return match ? &entry : nullptr;
+}
+
+enum AuditAction : uint8_t
+{
+    AUDIT_VIEW = 1,
+    AUDIT_REGISTER,
+    AUDIT_UPDATE,
+    AUDIT_DELETE
+};
+
+struct AuditEvent
+{
+    int64_t timestamp; // microseconds since the epoch
+    int32_t patientId;
+    uint8_t action;
+    char actor[19];
+};
+
+// Single-producer ring owned by one thread; the audit drainer is its only consumer
+struct AuditRing
+{
+    static const size_t capacity = 4096;
+    AuditEvent events[capacity];
+    atomic<size_t> head{0}, tail{0};
+    atomic<bool> retired{false}; // no more events will be written; freed once drained
+};
+
+// Records who viewed or changed which patient. Recording only writes into
+// the calling thread's ring; a background thread drains all rings into
+// audit.log, rotating it into numbered segments with a sorted
+// (patient ID, record number) index so history lookups are binary searches.
+class AuditTrail
+{
+    // The calling thread's ring. When the thread exits, or the ring fills
+    // and is swapped for a fresh one, it is retired, and the drainer frees
+    // it after copying out what is left.
+    struct RingHandle
+    {
+        AuditRing *ring = nullptr;
+        ~RingHandle()
+        {
+            if (ring)
+                ring->retired.store(true, memory_order_release);
+        }
+    };
+
+    static AuditTrail *instance;
+    static thread_local RingHandle handle;
+    static thread_local char actor[sizeof(AuditEvent::actor)];
+    const string logFile = "audit.log";
+    static const long long maxSegmentBytes = 4 * 1024 * 1024;
+
+    struct IndexEntry
+    {
+        int32_t patientId;
+        uint32_t record;
+    };
+
+    vector<AuditRing *> rings;
+    mutex ringsLock, drainLock;
+    condition_variable drainWanted;
+    bool running = true;
+    int nextSegment = 1;
+    thread drainer;
+
+    AuditTrail()
+    {
+        while (ifstream(segmentName(nextSegment)).good())
+            nextSegment++;
+        drainer = thread(&AuditTrail::drainLoop, this);
+    }
+
+    string segmentName(int segment) const { return logFile + "." + to_string(segment); }
+
+    AuditRing *registerRing()
+    {
+        lock_guard<mutex> guard(ringsLock);
+        rings.push_back(new AuditRing);
+        return rings.back();
+    }
+
+    void drainLoop()
+    {
+        unique_lock<mutex> guard(drainLock);
+        while (running)
+        {
+            drainWanted.wait_for(guard, chrono::milliseconds(50));
+            drain();
+        }
+        drain();
+    }
+
+    // Caller holds drainLock
+    void drain()
+    {
+        vector<AuditRing *> current;
+        {
+            lock_guard<mutex> guard(ringsLock);
+            current = rings;
+        }
+
+        vector<AuditEvent> events;
+        vector<AuditRing *> finished;
+        for (AuditRing *r : current)
+        {
+            // Checked first: a retired ring's last event is published before the flag
+            bool retired = r->retired.load(memory_order_acquire);
+            size_t tail = r->tail.load(memory_order_relaxed), head = r->head.load(memory_order_acquire);
+            for (size_t i = tail; i < head; i++)
+                events.push_back(r->events[i % AuditRing::capacity]);
+            r->tail.store(head, memory_order_release);
+            if (retired)
+                finished.push_back(r);
+        }
+        if (!finished.empty())
+        {
+            lock_guard<mutex> guard(ringsLock);
+            for (AuditRing *r : finished)
+            {
+                rings.erase(find(rings.begin(), rings.end(), r));
+                delete r;
+            }
+        }
+        if (events.empty())
+            return;
+
+        stable_sort(events.begin(), events.end(), [](const AuditEvent &a, const AuditEvent &b)
+                    { return a.timestamp < b.timestamp; });
+
+        ofstream file(logFile, ios::binary | ios::app);
+        file.write((const char *)events.data(), (streamsize)(events.size() * sizeof(AuditEvent)));
+        long long size = file.tellp();
+        file.close();
+        if (!file)
+        {
+            cout << "Could not write audit log\n";
+            return;
+        }
+        if (size >= maxSegmentBytes)
+            rotate();
+    }
+
+    void rotate()
+    {
+        vector<AuditEvent> events = readSegment(logFile);
+        vector<IndexEntry> index;
+        for (size_t i = 0; i < events.size(); i++)
+            index.push_back({events[i].patientId, (uint32_t)i});
+        sort(index.begin(), index.end(), [](const IndexEntry &a, const IndexEntry &b)
+             { return a.patientId != b.patientId ? a.patientId < b.patientId : a.record < b.record; });
+
+        string segment = segmentName(nextSegment);
+        ofstream indexFile(segment + ".idx", ios::binary | ios::trunc);
+        indexFile.write((const char *)index.data(), (streamsize)(index.size() * sizeof(IndexEntry)));
+        indexFile.close();
+        if (!indexFile || rename(logFile.c_str(), segment.c_str()) != 0)
+        {
+            cout << "Could not rotate audit log\n";
+            return;
+        }
+        nextSegment++;
+    }
+
+    static vector<AuditEvent> readSegment(const string &name)
+    {
+        ifstream file(name, ios::binary | ios::ate);
+        vector<AuditEvent> events;
+        if (!file)
+            return events;
+        events.resize((size_t)file.tellg() / sizeof(AuditEvent));
+        file.seekg(0);
+        file.read((char *)events.data(), (streamsize)(events.size() * sizeof(AuditEvent)));
+        return events;
+    }
+
+    // Binary search of a rotated segment's index for one patient's events
+    void searchSegment(int segment, int patientId, vector<AuditEvent> &events)
+    {
+        string name = segmentName(segment);
+        ifstream index(name + ".idx", ios::binary | ios::ate);
+        ifstream log(name, ios::binary);
+        if (!index || !log)
+            return;
+
+        IndexEntry entry;
+        size_t low = 0, high = (size_t)index.tellg() / sizeof(IndexEntry);
+        while (low < high)
+        {
+            size_t mid = (low + high) / 2;
+            index.seekg((streamoff)(mid * sizeof(IndexEntry)));
+            index.read((char *)&entry, sizeof entry);
+            if (entry.patientId < patientId)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+        index.seekg((streamoff)(low * sizeof(IndexEntry)));
+        while (index.read((char *)&entry, sizeof entry) && entry.patientId == patientId)
+        {
+            AuditEvent event;
+            log.seekg((streamoff)(entry.record * sizeof(AuditEvent)));
+            if (log.read((char *)&event, sizeof event))
+                events.push_back(event);
+        }
+    }
+
+public:
+    static AuditTrail *getInstance()
+    {
+        if (!instance)
+            instance = new AuditTrail();
+        return instance;
+    }
+
+    // Name recorded on events from the calling thread
+    static void setActor(const char *name)
+    {
+        strncpy(actor, name, sizeof actor - 1);
+        actor[sizeof actor - 1] = '\0';
+    }
+
+    void record(AuditAction action, int patientId)
+    {
+        if (!handle.ring)
+            handle.ring = registerRing();
+        AuditRing *ring = handle.ring;
+
+        size_t head = ring->head.load(memory_order_relaxed);
+        // Full ring: leave it to the drainer and carry on in a fresh one,
+        // rather than lose events, spin or wait on the log file
+        if (head - ring->tail.load(memory_order_acquire) == AuditRing::capacity)
+        {
+            ring->retired.store(true, memory_order_release);
+            handle.ring = ring = registerRing();
+            head = 0;
+            drainWanted.notify_one();
+        }
+
+        AuditEvent &event = ring->events[head % AuditRing::capacity];
+        event.timestamp = chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        event.patientId = patientId;
+        event.action = action;
+        memcpy(event.actor, actor, sizeof actor);
+        ring->head.store(head + 1, memory_order_release);
+    }
+
+    vector<AuditEvent> history(int patientId)
+    {
+        lock_guard<mutex> guard(drainLock);
+        drain();
+
+        vector<AuditEvent> events;
+        for (int segment = 1; segment < nextSegment; segment++)
+            searchSegment(segment, patientId, events);
+        for (const AuditEvent &event : readSegment(logFile))
+            if (event.patientId == patientId)
+                events.push_back(event);
+        return events;
+    }
+
+    void shutdown()
+    {
+        {
+            lock_guard<mutex> guard(drainLock);
+            if (!running)
+                return;
+            running = false;
+        }
+        drainWanted.notify_all();
+        drainer.join();
+    }
+};
+
+AuditTrail *AuditTrail::instance = nullptr;
+thread_local AuditTrail::RingHandle AuditTrail::handle;
+thread_local char AuditTrail::actor[sizeof(AuditEvent::actor)] = "";
+
+// Ordered, durable feed of committed patient changes for downstream systems
+// (lab, billing). Each line of changes.log is "seq|kind|payload": kind R is a
+// registration and U an update, both carrying the full record, and D a
+// deletion carrying the id. Sequence numbers only grow, so a consumer keeps
+// the last one it processed and resumes after it.
+class ChangeFeed
+{
+    static constexpr const char *feedFile = "changes.log";
+    long long lastSeq = 0;
+    bool needsNewline = false;
+    string unsent; // numbered lines a failed append still owes the file
+
+public:
+    static long long parseSeq(const string &line)
+    {
+        long long seq = 0;
+        size_t i = 0;
+        for (; i < line.size() && isdigit((unsigned char)line[i]); i++)
+            seq = seq * 10 + (line[i] - '0');
+        return i && i < line.size() && line[i] == '|' ? seq : -1;
+    }
+
+private:
+    // Offset of the first line that starts after pos, or the file size
+    static long long nextLineStart(ifstream &file, long long pos, long long size)
+    {
+        if (pos == 0)
+            return 0;
+        file.clear();
+        file.seekg(pos - 1);
+        string skipped;
+        getline(file, skipped);
+        return file && !file.eof() ? pos + (long long)skipped.size() : size;
+    }
+
+public:
+    // Resumes numbering from the last complete line; a torn final line from
+    // a crash is fenced off with a newline before the next append
+    ChangeFeed()
+    {
+        ifstream file(feedFile, ios::binary | ios::ate);
+        if (!file)
+            return;
+        long long size = (long long)file.tellg();
+        long long start = max(0LL, size - 65536);
+        string tail((size_t)(size - start), '\0');
+        file.seekg(start);
+        file.read(&tail[0], (streamsize)tail.size());
+        needsNewline = !tail.empty() && tail.back() != '\n';
+
+        // The scan may start mid-line, and the last line may be torn; neither
+        // has a sequence number to trust, so only whole lines count
+        size_t from = 0;
+        if (start > 0)
+        {
+            from = tail.find('\n');
+            from = from == string::npos ? tail.size() : from + 1;
+        }
+        size_t to = needsNewline ? tail.rfind('\n') + 1 : tail.size();
+        stringstream lines(to > from ? tail.substr(from, to - from) : string());
+        string line;
+        while (getline(lines, line))
+            lastSeq = max(lastSeq, parseSeq(line));
+    }
+
+    long long getLastSeq() const { return lastSeq; }
+
+    // Writer thread only: entries are "kind|payload", appended in commit
+    // order. If the write fails, the numbered lines are written again ahead
+    // of the next entries; readers apply a repeated line harmlessly.
+    void append(const vector<string> &entries)
+    {
+        for (const string &entry : entries)
+            unsent += to_string(++lastSeq) + "|" + entry + "\n";
+        if (unsent.empty())
+            return;
+        ofstream file(feedFile, ios::binary | ios::app);
+        if (!file)
+            throw FileOperationException("Could not open change feed");
+        if (needsNewline)
+            file << "\n";
+        file << unsent;
+        file.close();
+        // A short write may leave a torn line; fence it off before the retry
+        needsNewline = !file;
+        if (!file)
+            throw FileOperationException("Could not write change feed");
+        unsent.clear();
+    }
+
+    // Byte offset of the first change after seq. Lines are in sequence
+    // order, so a binary search over byte positions finds it in O(log n) reads.
+    static long long offsetAfter(long long seq)
+    {
+        ifstream file(feedFile, ios::binary | ios::ate);
+        if (!file)
+            return 0;
+        long long size = (long long)file.tellg(), lo = 0, hi = size;
+        string line;
+        while (hi - lo > 4096)
+        {
+            long long mid = lo + (hi - lo) / 2;
+            long long start = nextLineStart(file, mid, size);
+            if (start >= hi)
+            {
+                hi = mid;
+                continue;
+            }
+            file.clear();
+            file.seekg(start);
+            getline(file, line);
+            long long lineSeq = parseSeq(line);
+            if (lineSeq >= 0 && lineSeq <= seq)
+                lo = start;
+            else
+                hi = mid;
+        }
+
+        file.clear();
+        file.seekg(lo);
+        long long offset = lo;
+        while (getline(file, line) && !file.eof())
+        {
+            if (parseSeq(line) > seq)
+                return offset;
+            offset += (long long)line.size() + 1;
+        }
+        return offset;
+    }
+
+    // Appends the complete lines from offset on and advances offset past them.
+    // A line without its newline is still being written and is left for later.
+    static void readFrom(long long &offset, vector<string> &lines)
+    {
+        ifstream file(feedFile, ios::binary);
+        if (!file)
+            return;
+        file.seekg(offset);
+        string line;
+        while (getline(file, line) && !file.eof())
+        {
+            offset += (long long)line.size() + 1;
+            lines.push_back(line);
+        }
+    }
+
+    // Prints every change after seq; with follow, keeps polling for new ones
+    static void tail(long long afterSeq, bool follow)
+    {
+        long long offset = offsetAfter(afterSeq);
+        while (true)
+        {
+            vector<string> lines;
+            readFrom(offset, lines);
+            for (const string &line : lines)
+                if (parseSeq(line) > afterSeq)
+                    cout << line << "\n";
+            cout.flush();
+            if (!follow)
+                return;
+            this_thread::sleep_for(chrono::milliseconds(250));
+        }
+    }
+};
+
+// In-memory copy of the patient store for a follower process. It loads
+// patients.txt once, then tails the primary's changes.log, so view and
+// search never touch the primary. Replaying changes the file already
+// contains is harmless because every entry carries the full record state.
+class ReplicaStore
+{
+    mutable mutex lock;
+    unordered_map<int, shared_ptr<const Patient>> records;
+    long long appliedSeq = 0;
+    // Held while reading the feed so readers aren't blocked on file I/O
+    mutex feedLock;
+    long long feedOffset = 0;
+    chrono::steady_clock::time_point lastSync;
+    chrono::milliseconds maxStaleness;
+    mutex pollLock;
+    condition_variable stopWanted;
+    bool running = true;
+    thread poller;
+
+    void apply(const vector<string> &lines)
+    {
+        lock_guard<mutex> guard(lock);
+        for (const string &line : lines)
+        {
+            long long seq = ChangeFeed::parseSeq(line);
+            size_t kindAt = line.find('|') + 1;
+            if (seq < 0 || kindAt + 2 > line.size() || line[kindAt + 1] != '|')
+                continue;
+            string payload = line.substr(kindAt + 2);
+            if (line[kindAt] == 'D')
+                records.erase(atoi(payload.c_str()));
+            else
+            {
+                // A torn tail line is fenced off by the next writer but
+                // still arrives here; it never parses, so it is skipped
+                auto p = make_shared<Patient>();
+                if (!PatientSchema::parse(payload, *p))
+                    continue;
+                auto current = records.find(p->getId());
+                p->setVersion(current != records.end() ? current->second->getVersion() + 1 : 1);
+                records[p->getId()] = p;
+            }
+            appliedSeq = max(appliedSeq, seq);
+        }
+        lastSync = chrono::steady_clock::now();
+    }
+
+    void pollLoop()
+    {
+        unique_lock<mutex> guard(pollLock);
+        while (!stopWanted.wait_for(guard, maxStaleness / 2, [this]
+                                    { return !running; }))
+            sync();
+    }
+
+public:
+    ReplicaStore(chrono::milliseconds maxStaleness) : maxStaleness(maxStaleness)
+    {
+        // Take the feed position first: anything committed while the file
+        // is being read is replayed on top of it
+        appliedSeq = ChangeFeed().getLastSeq();
+        feedOffset = ChangeFeed::offsetAfter(LLONG_MAX);
+        ifstream file("patients.txt");
+        string line, record;
+        uint32_t version;
+        while (getline(file, line))
+        {
+            auto p = make_shared<Patient>();
+            if (line.empty() || RecordChecksum::open(line, record, &version) == RecordChecksum::Corrupt ||
+                !PatientSchema::parse(record, *p))
+                continue;
+            p->setVersion(max(version, 1u));
+            records[p->getId()] = p;
+        }
+        sync();
+        poller = thread(&ReplicaStore::pollLoop, this);
+    }
+
+    ~ReplicaStore()
+    {
+        {
+            lock_guard<mutex> guard(pollLock);
+            running = false;
+        }
+        stopWanted.notify_all();
+        if (poller.joinable())
+            poller.join();
+    }
+
+    void sync()
+    {
+        // Readers that catch up inline share the feed offset with the poller
+        lock_guard<mutex> guard(feedLock);
+        vector<string> lines;
+        ChangeFeed::readFrom(feedOffset, lines);
+        apply(lines);
+    }
+
+    // Reads are at most maxStaleness behind the primary's last flushed
+    // batch; if the poller has fallen behind, the reader catches up first
+    void ensureFresh()
+    {
+        bool stale;
+        {
+            lock_guard<mutex> guard(lock);
+            stale = chrono::steady_clock::now() - lastSync > maxStaleness;
+        }
+        if (stale)
+            sync();
+    }
+
+    bool find(int id, Patient &out)
+    {
+        ensureFresh();
+        shared_ptr<const Patient> p;
+        {
+            lock_guard<mutex> guard(lock);
+            auto it = records.find(id);
+            if (it == records.end())
+                return false;
+            p = it->second;
+        }
+        out = *p;
+        return true;
+    }
+
+    // Case-insensitive substring match on the name, in id order
+    vector<Patient> searchByName(const string &text)
+    {
+        ensureFresh();
+        string needle = text;
+        transform(needle.begin(), needle.end(), needle.begin(), ::tolower);
+        vector<shared_ptr<const Patient>> hits;
+        {
+            lock_guard<mutex> guard(lock);
+            for (auto &entry : records)
+            {
+                string name = entry.second->getName();
+                transform(name.begin(), name.end(), name.begin(), ::tolower);
+                if (name.find(needle) != string::npos)
+                    hits.push_back(entry.second);
+            }
+        }
+        sort(hits.begin(), hits.end(), [](const shared_ptr<const Patient> &a, const shared_ptr<const Patient> &b)
+             { return a->getId() < b->getId(); });
+        vector<Patient> result;
+        for (auto &p : hits)
+            result.push_back(*p);
+        return result;
+    }
+
+    vector<int> ids() const
+    {
+        lock_guard<mutex> guard(lock);
+        vector<int> result;
+        for (auto &entry : records)
+            result.push_back(entry.first);
+        return result;
+    }
+
+    size_t size() const
+    {
+        lock_guard<mutex> guard(lock);
+        return records.size();
+    }
+
+    long long getAppliedSeq() const
+    {
+        lock_guard<mutex> guard(lock);
+        return appliedSeq;
+    }
+
+    double millisSinceSync() const
+    {
+        lock_guard<mutex> guard(lock);
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - lastSync).count();
+    }
+};
+
+enum VitalMetric
+{
+    VITAL_HEART_RATE,
+    VITAL_SYSTOLIC,
+    VITAL_DIASTOLIC,
+    VITAL_TEMPERATURE,
+    VITAL_SPO2,
+    VITAL_METRIC_COUNT
+};
+
+// Values are stored as integers in units of 1/scale
+struct VitalMetricInfo
+{
+    const char *name, *unit;
+    int scale, minValue, maxValue;
+};
+
+constexpr VitalMetricInfo vitalMetrics[VITAL_METRIC_COUNT] = {
+    {"Heart rate", "bpm", 1, 20, 300},
+    {"Systolic pressure", "mmHg", 1, 40, 300},
+    {"Diastolic pressure", "mmHg", 1, 20, 200},
+    {"Temperature", "C", 10, 250, 450},
+    {"SpO2", "%", 1, 50, 100},
+};
+
+struct VitalsSummary
+{
+    long long count = 0;
+    int minValue = 0, maxValue = 0;
+    long long sum = 0;
+};
+
+// Time-series store for ward monitor readings, one column per patient and
+// metric. Each column is a run of chunks of up to 512 samples; after the
+// first sample a chunk holds delta-of-delta timestamps and values as zigzag
+// varints, so regular readings cost about two bytes. Chunk headers keep
+// min/max/sum, so a window query only decodes the chunks at its two edges.
+// Full chunks are appended to vitals.dat; open ones are written at shutdown.
+class VitalsStore
+{
+    static VitalsStore *instance;
+    const char *vitalsFile; // nullptr keeps every reading in memory only
+    static const uint32_t chunkSamples = 512;
+
+    struct Chunk
+    {
+        int64_t firstTime, lastTime; // milliseconds since the epoch
+        int32_t firstValue, minValue, maxValue;
+        int64_t sum;
+        uint32_t count;
+        string data;
+        // Encoder state for appending; a full or persisted chunk is never appended to
+        int64_t timeDelta, valueDelta;
+        int32_t lastValue;
+        bool persisted; // written to the vitals file
+    };
+
+    struct Column
+    {
+        vector<Chunk> chunks;
+    };
+
+    unordered_map<int64_t, Column> columns; // key: patientId * VITAL_METRIC_COUNT + metric
+    mutex lock;
+    bool open = true;
+
+    static int64_t key(int patientId, VitalMetric metric) { return (int64_t)patientId * VITAL_METRIC_COUNT + metric; }
+
+    static void putVarint(string &out, int64_t value)
+    {
+        uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+        while (zigzag >= 0x80)
+        {
+            out += (char)((zigzag & 0x7F) | 0x80);
+            zigzag >>= 7;
+        }
+        out += (char)zigzag;
+    }
+
+    static int64_t getVarint(const string &in, size_t &pos)
+    {
+        uint64_t zigzag = 0;
+        for (int shift = 0; pos < in.size(); shift += 7)
+        {
+            uint8_t byte = (uint8_t)in[pos++];
+            zigzag |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        return (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+    }
+
+    // Calls visit(time, value) for every sample in the chunk
+    template <typename Visitor>
+    static void decode(const Chunk &chunk, Visitor visit)
+    {
+        int64_t time = chunk.firstTime, timeDelta = 0, valueDelta = 0;
+        int32_t value = chunk.firstValue;
+        visit(time, value);
+        size_t pos = 0;
+        for (uint32_t i = 1; i < chunk.count; i++)
+        {
+            timeDelta += getVarint(chunk.data, pos);
+            valueDelta += getVarint(chunk.data, pos);
+            time += timeDelta;
+            value += (int32_t)valueDelta;
+            visit(time, value);
+        }
+    }
+
+    void writeChunk(ofstream &file, int64_t columnKey, const Chunk &chunk)
+    {
+        uint32_t length = (uint32_t)chunk.data.size();
+        file.write((const char *)&columnKey, sizeof columnKey);
+        for (int64_t field : {chunk.firstTime, chunk.lastTime, chunk.sum})
+            file.write((const char *)&field, sizeof field);
+        for (int32_t field : {chunk.firstValue, chunk.minValue, chunk.maxValue})
+            file.write((const char *)&field, sizeof field);
+        file.write((const char *)&chunk.count, sizeof chunk.count);
+        file.write((const char *)&length, sizeof length);
+        file.write(chunk.data.data(), length);
+    }
+
+    // Appends the column's chunks that aren't on disk yet, oldest first so
+    // the file stays in time order. A failed write is cut back off the file
+    // and its chunks stay pending, to go out with the column's next full one.
+    bool persist(int64_t columnKey, vector<Chunk> &chunks)
+    {
+        size_t first = chunks.size();
+        while (first > 0 && !chunks[first - 1].persisted)
+            first--;
+        if (first == chunks.size())
+            return true;
+
+        struct stat info;
+        off_t before = stat(vitalsFile, &info) == 0 ? info.st_size : 0;
+        ofstream file(vitalsFile, ios::binary | ios::app);
+        for (size_t i = first; i < chunks.size(); i++)
+            writeChunk(file, columnKey, chunks[i]);
+        file.close();
+        if (!file)
+        {
+            // Otherwise the next load would stop at the partial chunk
+            if (truncate(vitalsFile, before) != 0)
+                cout << "Could not trim a partial chunk from " << vitalsFile << endl;
+            return false;
+        }
+        for (size_t i = first; i < chunks.size(); i++)
+        {
+            chunks[i].persisted = true;
+            chunks[i].data.shrink_to_fit();
+        }
+        return true;
+    }
+
+    template <typename T>
+    static bool readRaw(const string &buffer, size_t &pos, T &value)
+    {
+        if (pos + sizeof value > buffer.size())
+            return false;
+        memcpy(&value, buffer.data() + pos, sizeof value);
+        pos += sizeof value;
+        return true;
+    }
+
+    // A torn last record is cut off, so chunks appended afterwards follow
+    // the last good one instead of being hidden behind the garbage
+    void load()
+    {
+        ifstream file(vitalsFile, ios::binary | ios::ate);
+        if (!file)
+            return;
+        string buffer((size_t)file.tellg(), '\0');
+        file.seekg(0);
+        file.read(&buffer[0], (streamsize)buffer.size());
+        file.close();
+
+        size_t pos = 0, good = 0;
+        while (true)
+        {
+            int64_t columnKey;
+            int64_t times[3];
+            int32_t values[3];
+            Chunk chunk{};
+            uint32_t length;
+            // Two varints of at most 10 bytes per sample after the first
+            if (!readRaw(buffer, pos, columnKey) || !readRaw(buffer, pos, times) || !readRaw(buffer, pos, values) ||
+                !readRaw(buffer, pos, chunk.count) || !readRaw(buffer, pos, length) || chunk.count == 0 ||
+                chunk.count > chunkSamples || length > 20 * chunkSamples || pos + length > buffer.size())
+                break;
+            chunk.data.assign(buffer, pos, length);
+            pos += length;
+            good = pos;
+            chunk.firstTime = times[0];
+            chunk.lastTime = times[1];
+            chunk.sum = times[2];
+            chunk.firstValue = values[0];
+            chunk.minValue = values[1];
+            chunk.maxValue = values[2];
+            chunk.persisted = true;
+            columns[columnKey].chunks.push_back(move(chunk));
+        }
+
+        if (good < buffer.size())
+        {
+            string tempFile = string(vitalsFile) + ".tmp";
+            {
+                ofstream out(tempFile, ios::binary | ios::trunc);
+                if (!out.write(buffer.data(), (streamsize)good))
+                    throw FileOperationException("Could not repair vitals file");
+            }
+            if (rename(tempFile.c_str(), vitalsFile) != 0)
+                throw FileOperationException("Could not repair vitals file");
+        }
+    }
+
+public:
+    // The singleton uses vitals.dat; benchmarks make their own with no file
+    explicit VitalsStore(const char *file) : vitalsFile(file)
+    {
+        if (vitalsFile)
+            load();
+    }
+
+    static VitalsStore *getInstance()
+    {
+        if (!instance)
+            instance = new VitalsStore("vitals.dat");
+        return instance;
+    }
+
+    static bool isInRange(VitalMetric metric, int value)
+    {
+        return value >= vitalMetrics[metric].minValue && value <= vitalMetrics[metric].maxValue;
+    }
+
+    // Samples must arrive in time order per patient and metric; a reading
+    // older than the last one, or out of range, is rejected
+    bool record(int patientId, VitalMetric metric, int64_t time, int value)
+    {
+        if (!isInRange(metric, value))
+            return false;
+        lock_guard<mutex> guard(lock);
+        if (!open)
+            return false;
+        int64_t columnKey = key(patientId, metric);
+        Column &column = columns[columnKey];
+        if (!column.chunks.empty() && time < column.chunks.back().lastTime)
+            return false;
+
+        if (column.chunks.empty() || column.chunks.back().persisted || column.chunks.back().count == chunkSamples)
+        {
+            Chunk chunk{};
+            chunk.firstTime = chunk.lastTime = time;
+            chunk.firstValue = chunk.minValue = chunk.maxValue = chunk.lastValue = value;
+            chunk.sum = value;
+            chunk.count = 1;
+            column.chunks.push_back(move(chunk));
+            return true;
+        }
+
+        Chunk &chunk = column.chunks.back();
+        int64_t timeDelta = time - chunk.lastTime, valueDelta = (int64_t)value - chunk.lastValue;
+        putVarint(chunk.data, timeDelta - chunk.timeDelta);
+        putVarint(chunk.data, valueDelta - chunk.valueDelta);
+        chunk.timeDelta = timeDelta;
+        chunk.valueDelta = valueDelta;
+        chunk.lastTime = time;
+        chunk.lastValue = value;
+        chunk.minValue = min(chunk.minValue, (int32_t)value);
+        chunk.maxValue = max(chunk.maxValue, (int32_t)value);
+        chunk.sum += value;
+        chunk.count++;
+
+        if (chunk.count == chunkSamples)
+        {
+            if (!vitalsFile)
+            {
+                chunk.persisted = true;
+                chunk.data.shrink_to_fit();
+            }
+            else
+                persist(columnKey, column.chunks);
+        }
+        return true;
+    }
+
+    // min/max/avg over [from, to]
+    VitalsSummary query(int patientId, VitalMetric metric, int64_t from, int64_t to)
+    {
+        VitalsSummary summary;
+        auto add = [&summary](int minValue, int maxValue, long long sum, long long count)
+        {
+            summary.minValue = summary.count ? min(summary.minValue, minValue) : minValue;
+            summary.maxValue = summary.count ? max(summary.maxValue, maxValue) : maxValue;
+            summary.sum += sum;
+            summary.count += count;
+        };
+
+        lock_guard<mutex> guard(lock);
+        auto it = columns.find(key(patientId, metric));
+        if (it == columns.end())
+            return summary;
+
+        const vector<Chunk> &chunks = it->second.chunks;
+        // Chunks are in time order: skip straight to the first that can overlap
+        auto first = lower_bound(chunks.begin(), chunks.end(), from, [](const Chunk &chunk, int64_t time)
+                                 { return chunk.lastTime < time; });
+        for (auto chunk = first; chunk != chunks.end() && chunk->firstTime <= to; ++chunk)
+        {
+            if (chunk->firstTime >= from && chunk->lastTime <= to)
+                add(chunk->minValue, chunk->maxValue, chunk->sum, chunk->count);
+            else
+                decode(*chunk, [&](int64_t time, int32_t value)
+                       {
+                    if (time >= from && time <= to)
+                        add(value, value, value, 1); });
+        }
+        return summary;
+    }
+
+    void report(size_t &samples, size_t &bytes)
+    {
+        lock_guard<mutex> guard(lock);
+        samples = bytes = 0;
+        for (auto &column : columns)
+            for (const Chunk &chunk : column.second.chunks)
+            {
+                samples += chunk.count;
+                bytes += chunk.data.size() + sizeof(Chunk);
+            }
+    }
+
+    // Writes the chunks still open so no reading is lost at exit
+    void shutdown()
+    {
+        lock_guard<mutex> guard(lock);
+        if (!open)
+            return;
+        open = false;
+        if (!vitalsFile)
+            return;
+        bool failed = false;
+        for (auto &column : columns)
+            if (!persist(column.first, column.second.chunks))
+                failed = true;
+        if (failed)
+            cout << "Error saving vitals: Could not write " << vitalsFile << endl;
+    }
+};
+
+VitalsStore *VitalsStore::instance = nullptr;
+
+// A logged-in staff member; credentials are checked by StaffDirectory
+class User
+{
+protected:
+    char *username;
+    uint32_t permissions;
+
+public:
+    User(const char *username, uint32_t permissions)
+    {
+        this->username = MemoryAccounting::copyString(MEM_USERS, username);
+        this->permissions = permissions;
+        // Roles add no state, so the base size is the object size
+        MemoryAccounting::allocated(MEM_USERS, sizeof(User));
+    }
+
+    virtual ~User()
+    {
+        MemoryAccounting::freeString(MEM_USERS, username);
+        MemoryAccounting::freed(MEM_USERS, sizeof(User));
+    }
+    const char *getUsername() const { return username; }
+    uint32_t getPermissions() const { return permissions; }
+    virtual MenuStrategy *createMenuStrategy() = 0;
+
+    // Builds the user for an account's role
+    static User *create(const string &role, const char *username, uint32_t permissions);
+};
+
+// Storage the menus and scripted sessions work against. getInstance returns
+// the engine chosen at startup: FileHandler keeps the pipe-delimited text
+// files, MemoryStorageEngine keeps everything in RAM.
+class StorageEngine
+{
+    static StorageEngine *instance;
+    static bool inMemory;
+
+protected:
+    enum WriteKind
+    {
+        WRITE_SAVE,
+        WRITE_UPDATE,
+        WRITE_DELETE
+    };
+
+    struct PendingWrite
+    {
+        WriteKind kind;
+        Patient patient;
+        uint32_t baseVersion = 0; // version the write replaces; 0 for a new record
+        bool archived = false;    // a delete of an archived patient: only the feed and journal change
+        bool movedToArchive = false; // a delete that moved the patient to the archive: not published
+    };
+
+    // Transaction rule both engines follow: an update is checked against the
+    // version its record had before the transaction, if it existed then, and
+    // builds on whatever the transaction has already written to it
+    static void stampUpdate(Patient &p, const Patient *original, const Patient *current)
+    {
+        if (original && p.getVersion() != original->getVersion())
+            throw VersionConflictException();
+        if (current)
+            p.setVersion(current->getVersion());
+    }
+
+public:
+    // Groups mutations so they commit together: checked up front, made
+    // visible to readers at once and, on disk, written in a single pass
+    class Transaction
+    {
+        friend class StorageEngine;
+        vector<PendingWrite> writes;
+
+    public:
+        void savePatient(const Patient &p) { writes.push_back({WRITE_SAVE, p}); }
+        void updatePatient(const Patient &p) { writes.push_back({WRITE_UPDATE, p}); }
+        void deletePatient(int id) { writes.push_back({WRITE_DELETE, Patient(id)}); }
+        int size() const { return (int)writes.size(); }
+        void rollback() { writes.clear(); }
+    };
+
+protected:
+    static vector<PendingWrite> &writesOf(Transaction &t) { return t.writes; }
+
+public:
+    // Must be called before the first getInstance; "text" or "memory".
+    // Returns false, leaving the choice alone, for any other name.
+    static bool select(const char *name)
+    {
+        if (strcmp(name, "text") != 0 && strcmp(name, "memory") != 0)
+            return false;
+        inMemory = strcmp(name, "memory") == 0;
+        return true;
+    }
+    static StorageEngine *getInstance();
+
+    virtual ~StorageEngine() {}
+
+    virtual void savePatient(const Patient &p) = 0;
+    virtual void updatePatient(const Patient &p) = 0;
+    virtual void deletePatient(int id) = 0;
+    Transaction beginTransaction() { return Transaction(); }
+    virtual void commit(Transaction &t) = 0;
+    virtual void flush() = 0;
+    // Error from a queued write that never reached disk, once, and cleared;
+    // empty if none. The refused change is no longer in memory either.
+    virtual string takeWriteError() { return ""; }
+    virtual void shutdown() = 0;
+
+    virtual Patient getPatient(int id) = 0;
+    virtual int getPatientCount() = 0;
+    // Active patients that are probably the candidate entered again
+    virtual vector<int> findDuplicates(const Patient &candidate) = 0;
+    virtual void loadAllPatients(Patient *&patients, int &count) = 0;
+    virtual void findByDiagnosis(const char *diagnosis, Patient *&patients, int &count) = 0;
+    virtual int getNextPatientId() = 0;
+
+    // Chunked read of every patient in ID order, starting from fromId =
+    // INT_MIN. readSnapshot appends the next chunk and returns false after
+    // the last one; each beginSnapshot needs a matching endSnapshot.
+    virtual long long beginSnapshot() = 0;
+    virtual bool readSnapshot(long long snapshot, int &fromId, vector<Patient> &out) = 0;
+    virtual void endSnapshot(long long snapshot) = 0;
+
+    virtual void touchPatient(int) {}
+    // Engines without a cold tier have nothing to archive
+    virtual int archiveInactivePatients(int) { return 0; }
+
+    virtual bool *getAccessRights(const char *role, int &count) = 0;
+    virtual void updateAccessRights(const char *role, const bool *rights, int count) = 0;
+    virtual void saveTriageQueue(const TriageEntry *entries, int count) = 0;
+    virtual void loadTriageQueue(TriageEntry *&entries, int &count) = 0;
+
+    // Prescriptions are append-only; saving assigns the id
+    virtual void savePrescription(Prescription &p) = 0;
+    virtual void loadPrescriptions(int patientId, Prescription *&prescriptions, int &count) = 0;
+
+    // Bed occupancy is a log of changes; loading returns the occupied beds
+    virtual void loadWardLayout(WardLayout *&layout, int &count) = 0;
+    virtual void saveBedAssignment(const BedAssignment &change) = 0;
+    virtual void loadBedAssignments(BedAssignment *&assignments, int &count) = 0;
+
+    virtual const char *getLoadSource() const = 0;
+    virtual double getStartupMillis() const { return 0; }
+    virtual int getCorruptRecordCount() const { return 0; }
+};
+
+// Exclusive advisory lock on a file, held for the object's lifetime, so
+// processes sharing the data directory take turns at patients.txt
+class FileLock
+{
+#ifdef __linux__
+    int fd;
+
+public:
+    explicit FileLock(const char *path) : fd(::open(path, O_RDWR | O_CREAT, 0644))
+    {
+        if (fd >= 0)
+            flock(fd, LOCK_EX);
+    }
+    ~FileLock()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+#else
+public:
+    explicit FileLock(const char *) {}
+#endif
+    FileLock(const FileLock &) = delete;
+    FileLock &operator=(const FileLock &) = delete;
+};
+
+class FileHandler : public StorageEngine
+{
+    static FileHandler *instance;
+    const char *patientFile = "patients.txt", *accessRightsFile = "access_rights.txt", *triageFile = "triage_queue.txt";
+    const char *checkpointFile = "patients.chk", *journalFile = "patients.journal";
+    const char *archiveFile = "patients.archive", *archiveIndexFile = "patients.archive.idx", *activityFile = "patient_activity.txt";
+    const char *archiveTreeFile = "patients.archive.bpt", *archiveBloomFile = "patients.archive.bloom";
+    const char *quarantineFile = "patients.quarantine", *prescriptionFile = "prescriptions.txt";
+    const char *wardFile = "wards.txt", *bedFile = "beds.txt", *patientLockFile = "patients.lock";
+
+    // In-memory registry that serves every read. Startup loads it from the
+    // binary checkpoint and replays the journal of batches written since,
+    // falling back to parsing patients.txt if they don't match the file.
+    IndexedRegistry registry;
+    mutex registryLock;
+    double startupMillis = 0;
+    bool loadedFromCheckpoint = false;
+    int corruptRecords = 0;
+    int journalEntries = 0;
+    static const int checkpointInterval = 1000;
+    // Snapshot readers take registryLock for one chunk at a time
+    static const size_t snapshotChunk = 4096;
+
+    // Cold tier: inactive patients moved out of the registry into
+    // block-compressed archive storage. The block index stays in memory so
+    // a lookup decompresses a single block.
+    struct ArchiveBlock
+    {
+        int firstId, lastId;
+        long long offset;
+        uint32_t compressedSize, rawSize;
+    };
+    static const int archiveBlockRecords = 64;
+    vector<ArchiveBlock> archiveBlocks;
+    // Patient ID -> archive block. The Bloom filter in front rejects IDs that
+    // were never archived without any I/O; hits cost one page read per level.
+    BPlusTreeIndex archiveIds;
+    BloomFilter archiveFilter;
+    int maxArchivedId = 0, lastIssuedId = 0;
+    unordered_map<int, time_t> lastTouched;
+
+    // Written by the writer thread after each batch is on disk
+    ChangeFeed changeFeed;
+
+    // Prescriptions by patient, loaded at startup and appended to on save
+    unordered_map<int, vector<Prescription>> prescriptions;
+    int lastPrescriptionId = 0;
+    mutex prescriptionLock;
+    mutex bedLock;
+
+    // Background writer: menu actions only queue their mutation. Repeated
+    // writes to one patient coalesce into a single pending entry, and each
+    // batch the writer takes costs at most one rewrite of the patient file.
+    static const size_t maxPendingWrites = 1024;
+    unordered_map<int, PendingWrite> pending;
+    vector<int> pendingOrder;
+    mutex writeLock;
+    condition_variable writesQueued, writesDone, queueNotFull;
+    bool writing = false, writerRunning = true;
+    string writeError;
+    thread writer;
+
+    // Set when a batch is refused before reaching disk: its changes are
+    // already in the registry, so the next refreshFromDisk reloads every
+    // record, and the next prompt shows refusedError
+    bool reloadAll = false;
+    atomic<bool> writeRefused{false};
+    string refusedError;
+
+    // Batches are numbered as the writer takes them. A failed batch keeps its
+    // error, how far it got and whether another process had changed one of
+    // its records, for the transaction waiting on it.
+    struct BatchFailure
+    {
+        string error;
+        bool onDisk = false, published = false, conflict = false;
+    };
+    long long nextBatch = 1, finishedBatch = 0;
+    map<long long, BatchFailure> failedBatches;
+
+    // diskStamp of patients.txt as of our last write or reload, under
+    // writeLock; a different one means another process has written since
+    string knownStamp;
+
+    FileHandler()
+    {
+        ifstream file(accessRightsFile);
+        if (!file.good())
+            initializeAccessRights();
+
+        auto started = chrono::steady_clock::now();
+        loadedFromCheckpoint = loadCheckpoint();
+        if (!loadedFromCheckpoint)
+        {
+            Patient *patients;
+            int count;
+            vector<string> corrupt;
+            readAllPatients(patients, count, &corrupt);
+            corruptRecords = (int)corrupt.size();
+            for (int i = 0; i < count; i++)
+            {
+                // Lines written before versions were stored start at 1
+                patients[i].setVersion(max(patients[i].getVersion(), 1u));
+                registry.put(patients[i]);
+            }
+            MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+            writeCheckpoint(buildCheckpoint(fileSize(patientFile)));
+        }
+        startupMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+        knownStamp = diskStamp();
+
+        loadArchiveIndex();
+        loadActivity();
+        loadPrescriptionFile();
+
+        writer = thread(&FileHandler::writerLoop, this);
+    }
+
+    static long long fileSize(const char *path)
+    {
+        ifstream file(path, ios::binary | ios::ate);
+        return file ? (long long)file.tellg() : -1;
+    }
+
+    // Changes whenever patients.txt is appended to or replaced
+    string diskStamp() const
+    {
+#ifdef __linux__
+        struct stat info;
+        if (stat(patientFile, &info) != 0)
+            return "";
+        return to_string(info.st_ino) + ":" + to_string(info.st_size) + ":" + to_string(info.st_mtim.tv_sec) + "." +
+               to_string(info.st_mtim.tv_nsec);
+#else
+        return to_string(fileSize(patientFile));
+#endif
+    }
+
+    // Caller holds registryLock. If another process has written patients.txt
+    // since we last did, takes its records, versions included, into the
+    // registry. Skipped while writes of ours are still on their way to disk;
+    // those are checked against the file when they get there.
+    void refreshFromDisk()
+    {
+        {
+            lock_guard<mutex> guard(writeLock);
+            if (!pendingOrder.empty() || writing || (!reloadAll && diskStamp() == knownStamp))
+                return;
+        }
+
+        Patient *patients;
+        int count;
+        bool everything;
+        {
+            FileLock fileGuard(patientLockFile);
+            readAllPatients(patients, count);
+            lock_guard<mutex> guard(writeLock);
+            knownStamp = diskStamp();
+            everything = reloadAll;
+            reloadAll = false;
+        }
+
+        unordered_map<int, bool> onDisk;
+        for (int i = 0; i < count; i++)
+        {
+            Patient &p = patients[i];
+            onDisk[p.getId()] = true;
+            const Patient *current = registry.find(p.getId());
+            // Version 0 is a line from before versions were stored: only new to us if we lack the id
+            if (!current || everything || (p.getVersion() != 0 && p.getVersion() != current->getVersion()))
+            {
+                p.setVersion(max(p.getVersion(), 1u));
+                registry.put(p);
+            }
+        }
+        MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+
+        vector<int> gone;
+        registry.forEach([&](const Patient &p)
+                         {
+            if (!onDisk.count(p.getId()))
+                gone.push_back(p.getId()); });
+        for (int id : gone)
+        {
+            registry.erase(id);
+            lastTouched.erase(id);
+        }
+    }
+
+    template <typename T>
+    static void appendRaw(string &buffer, T value) { buffer.append((const char *)&value, sizeof value); }
+
+    template <typename T>
+    static bool readRaw(const string &buffer, size_t &pos, T &value)
+    {
+        if (pos + sizeof value > buffer.size())
+            return false;
+        memcpy(&value, buffer.data() + pos, sizeof value);
+        pos += sizeof value;
+        return true;
+    }
+
+    // Checkpoint layout: magic, size of patients.txt it matches, record count,
+    // then per record id, age, gender, version and four length-prefixed strings.
+    // Caller holds registryLock.
+    string buildCheckpoint(long long textSize)
+    {
+        string buffer("HMSCHK03");
+        appendRaw(buffer, (int64_t)textSize);
+        appendRaw(buffer, (uint32_t)registry.size());
+        registry.forEach([&buffer](const Patient &p)
+                         {
+            appendRaw(buffer, (int32_t)p.getId());
+            appendRaw(buffer, (int32_t)p.getAge());
+            buffer += p.getGender();
+            appendRaw(buffer, (uint32_t)p.getVersion());
+            for (const char *field : {p.getName(), p.getAddress(), p.getContactNumber(), p.getDiagnosis()})
+            {
+                uint32_t length = (uint32_t)strlen(field);
+                appendRaw(buffer, length);
+                buffer.append(field, length);
+            } });
+        return buffer;
+    }
+
+    void writeCheckpoint(const string &buffer)
+    {
+        string temp = string(checkpointFile) + ".tmp";
+        {
+            ofstream file(temp, ios::binary | ios::trunc);
+            if (!file.write(buffer.data(), (streamsize)buffer.size()))
+                throw FileOperationException("Could not write checkpoint file");
+        }
+        // rename replaces the old checkpoint in one step
+        if (rename(temp.c_str(), checkpointFile) != 0)
+        {
+            remove(temp.c_str());
+            throw FileOperationException("Could not write checkpoint file");
+        }
+
+        // Everything in the journal is now covered by the checkpoint
+        ofstream journal(journalFile, ios::trunc);
+        journalEntries = 0;
+    }
+
+    bool loadCheckpoint()
+    {
+        ifstream file(checkpointFile, ios::binary | ios::ate);
+        if (!file)
+            return false;
+        string buffer((size_t)file.tellg(), '\0');
+        file.seekg(0);
+        file.read(&buffer[0], (streamsize)buffer.size());
+
+        size_t pos = 8;
+        int64_t textSize;
+        uint32_t count;
+        if (buffer.compare(0, 8, "HMSCHK03") != 0 || !readRaw(buffer, pos, textSize) || !readRaw(buffer, pos, count))
+            return false;
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            int32_t id, age;
+            uint32_t version;
+            string fields[4];
+            if (!readRaw(buffer, pos, id) || !readRaw(buffer, pos, age) || pos >= buffer.size())
+                break;
+            char gender = buffer[pos++];
+            if (!readRaw(buffer, pos, version))
+                break;
+            bool complete = true;
+            for (string &field : fields)
+            {
+                uint32_t length;
+                if (!readRaw(buffer, pos, length) || pos + length > buffer.size())
+                {
+                    complete = false;
+                    break;
+                }
+                field.assign(buffer, pos, length);
+                pos += length;
+            }
+            if (!complete)
+                break;
+            Patient p(id, fields[0].c_str(), age, gender, fields[1].c_str(), fields[2].c_str(), fields[3].c_str());
+            p.setVersion(version);
+            registry.put(p);
+        }
+
+        if (registry.size() != count)
+        {
+            registry.clear();
+            return false;
+        }
+
+        // Replay complete journal batches; each one ends with the file size it
+        // produced. A line that doesn't parse was torn by a crash mid-append,
+        // so the journal ends there and its batch is not replayed.
+        ifstream journal(journalFile);
+        string line;
+        vector<pair<bool, Patient>> batch; // (deleted, record)
+        while (getline(journal, line))
+        {
+            if (line.empty())
+                continue;
+            if (line.size() < 2 || line[1] != '|')
+                break;
+            const char *text = line.data() + 2, *end = line.data() + line.size();
+            if (line[0] == 'S')
+            {
+                int64_t size;
+                auto parsed = from_chars(text, end, size);
+                if (parsed.ec != errc() || parsed.ptr != end)
+                    break;
+                for (auto &entry : batch)
+                {
+                    Patient &p = entry.second;
+                    if (entry.first)
+                    {
+                        registry.erase(p.getId());
+                        continue;
+                    }
+                    registry.put(p);
+                }
+                journalEntries += (int)batch.size();
+                batch.clear();
+                textSize = size;
+            }
+            else if (line[0] == 'D')
+            {
+                int id;
+                auto parsed = from_chars(text, end, id);
+                if (parsed.ec != errc() || parsed.ptr != end)
+                    break;
+                batch.emplace_back(true, Patient(id));
+            }
+            else
+            {
+                // U|<version>|<record>: the version patients.txt was given
+                uint32_t version;
+                auto parsed = from_chars(text, end, version);
+                Patient p;
+                if (line[0] != 'U' || parsed.ec != errc() || parsed.ptr == end || *parsed.ptr != '|' || version == 0 ||
+                    !PatientSchema::parse(string_view(parsed.ptr + 1, end - parsed.ptr - 1), p))
+                    break;
+                p.setVersion(version);
+                batch.emplace_back(false, p);
+            }
+        }
+
+        if (textSize != fileSize(patientFile))
+        {
+            registry.clear();
+            journalEntries = 0;
+            return false;
+        }
+        return true;
+    }
+
+    // Runs on the writer thread between batches. Only checkpoints when the
+    // registry matches what is on disk, i.e. nothing is queued and no other
+    // process has written since.
+    void checkpointIfIdle()
+    {
+        string buffer;
+        {
+            unique_lock<mutex> registryGuard(registryLock, try_to_lock);
+            if (!registryGuard.owns_lock())
+                return;
+            lock_guard<mutex> guard(writeLock);
+            if (!pendingOrder.empty() || diskStamp() != knownStamp)
+                return;
+            buffer = buildCheckpoint(fileSize(patientFile));
+        }
+        writeCheckpoint(buffer);
+    }
+
+    template <typename T>
+    static bool parseInteger(const string &text, T &value)
+    {
+        auto result = from_chars(text.data(), text.data() + text.size(), value);
+        return !text.empty() && result.ec == errc() && result.ptr == text.data() + text.size();
+    }
+
+    // firstId|lastId|offset|compressedSize|rawSize
+    static bool parseArchiveBlock(const string &line, ArchiveBlock &block)
+    {
+        stringstream ss(line);
+        string first, last, offset, compressed, raw;
+        if (!getline(ss, first, '|') || !getline(ss, last, '|') || !getline(ss, offset, '|') ||
+            !getline(ss, compressed, '|') || !getline(ss, raw))
+            return false;
+        return parseInteger(first, block.firstId) && parseInteger(last, block.lastId) && parseInteger(offset, block.offset) &&
+               block.offset >= 0 && parseInteger(compressed, block.compressedSize) && parseInteger(raw, block.rawSize);
+    }
+
+    // Block numbers count the lines that parse. A crash mid-archive can only
+    // tear the last line, before any patient is mapped to its block, so
+    // skipping it loses nothing.
+    void loadArchiveIndex()
+    {
+        ifstream file(archiveIndexFile);
+        string line;
+        while (getline(file, line))
+        {
+            ArchiveBlock block;
+            if (line.empty() || !parseArchiveBlock(line, block))
+                continue;
+            archiveBlocks.push_back(block);
+            maxArchivedId = max(maxArchivedId, block.lastId);
+        }
+
+        bool indexed = archiveIds.open(archiveTreeFile);
+        if (!indexed && !archiveBlocks.empty())
+        {
+            // Archive predates the ID index: build it once from the blocks.
+            // An index that is there but empty is left alone, since its
+            // keys were erased when those patients were restored or deleted.
+            for (uint32_t i = 0; i < archiveBlocks.size(); i++)
+            {
+                stringstream records(readArchiveBlock(archiveBlocks[i]));
+                string line;
+                int id;
+                while (getline(records, line))
+                    if (parseInteger(line.substr(0, line.find('|')), id))
+                        archiveIds.insert(id, i);
+            }
+        }
+        if (!archiveFilter.load(archiveBloomFile))
+            rebuildArchiveFilter();
+    }
+
+    void rebuildArchiveFilter()
+    {
+        vector<int> ids;
+        archiveIds.forEachKey([&ids](int32_t id)
+                              { ids.push_back(id); });
+        // Leave headroom so a few more archive runs keep the rate low
+        archiveFilter.reset(ids.size() * 2);
+        for (int id : ids)
+            archiveFilter.add(id);
+        archiveFilter.save(archiveBloomFile);
+    }
+
+    string readArchiveBlock(const ArchiveBlock &block)
+    {
+        ifstream file(archiveFile, ios::binary);
+        string compressed(block.compressedSize, '\0'), raw;
+        file.seekg(block.offset);
+        if (!file.read(&compressed[0], (streamsize)compressed.size()) ||
+            !BlockCompressor::decompress(compressed, raw, block.rawSize))
+            throw FileOperationException("Patient archive is corrupted");
+        return raw;
+    }
+
+    // id|time per line; lines that don't parse are skipped
+    void loadActivity()
+    {
+        ifstream file(activityFile);
+        string line;
+        while (getline(file, line))
+        {
+            size_t bar = line.find('|');
+            int id;
+            long long touched;
+            if (bar != string::npos && parseInteger(line.substr(0, bar), id) && parseInteger(line.substr(bar + 1), touched))
+                lastTouched[id] = (time_t)touched;
+        }
+
+        // Records with no history count as touched now, so nothing is archived
+        // before it has actually been idle for the requested period
+        time_t now = time(nullptr);
+        registry.forEach([this, now](const Patient &p)
+                         { lastTouched.emplace(p.getId(), now); });
+    }
+
+    // Caller holds registryLock. Written aside and renamed over the old
+    // file, so a crash leaves one whole version or the other.
+    void saveActivity()
+    {
+        string tempFile = string(activityFile) + ".tmp";
+        ofstream file(tempFile);
+        if (!file)
+            throw FileOperationException("Could not open patient activity file");
+        for (const auto &entry : lastTouched)
+            file << entry.first << "|" << (long long)entry.second << "\n";
+        file.close();
+        if (!file || rename(tempFile.c_str(), activityFile) != 0)
+        {
+            remove(tempFile.c_str());
+            throw FileOperationException("Could not write patient activity file");
+        }
+    }
+
+    // Caller holds registryLock
+    bool findArchivedPatient(int id, Patient &p)
+    {
+        uint32_t block;
+        if (!archiveFilter.mightContain(id) || !archiveIds.find(id, block) || block >= archiveBlocks.size())
+            return false;
+
+        stringstream records(readArchiveBlock(archiveBlocks[block]));
+        string prefix = to_string(id) + "|", line;
+        while (getline(records, line))
+        {
+            if (line.compare(0, prefix.size(), prefix) == 0)
+            {
+                p.fromString(line);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Caller holds registryLock. Applies one mutation to the registry so reads
+    // see it immediately, stamps the patient with its new version and records
+    // the version it replaces. Updates are compare-and-swap on the version.
+    void applyToRegistry(PendingWrite &w)
+    {
+        WriteKind &kind = w.kind;
+        Patient &p = w.patient;
+        const Patient *found = registry.find(p.getId());
+        w.baseVersion = found ? found->getVersion() : 0;
+        uint32_t block;
+        if (!found && archiveFilter.mightContain(p.getId()) && archiveIds.find(p.getId(), block))
+        {
+            // Writing an archived patient brings it back to the hot tier;
+            // deleting one drops it from the archive index and still goes
+            // through the writer so the change feed hears of it
+            archiveIds.erase(p.getId());
+            if (kind == WRITE_DELETE)
+            {
+                w.archived = true;
+                return;
+            }
+            kind = WRITE_SAVE;
+        }
+
+        if (kind == WRITE_SAVE)
+        {
+            p.setVersion(found ? found->getVersion() + 1 : 1);
+            registry.put(p);
+        }
+        else if (!found)
+            throw PatientNotFoundException();
+        else if (kind == WRITE_UPDATE)
+        {
+            if (p.getVersion() != found->getVersion())
+                throw VersionConflictException();
+            p.setVersion(found->getVersion() + 1);
+            registry.put(p);
+        }
+        else
+            registry.erase(p.getId());
+
+        if (kind == WRITE_DELETE)
+            lastTouched.erase(p.getId());
+        else
+            lastTouched[p.getId()] = time(nullptr);
+    }
+
+    void enqueueWrite(WriteKind kind, const Patient &p)
+    {
+        // Holding registryLock while queueing keeps the disk order the same
+        // as the memory order
+        lock_guard<mutex> registryGuard(registryLock);
+        refreshFromDisk();
+        PendingWrite w{kind, p};
+        applyToRegistry(w);
+        queueWrites({w});
+    }
+
+    // Caller holds writeLock
+    void finishBatch(long long batch, const BatchFailure &outcome)
+    {
+        if (!outcome.error.empty())
+        {
+            writeError = outcome.error;
+            failedBatches[batch] = outcome;
+            if (!outcome.onDisk)
+            {
+                reloadAll = true;
+                refusedError = outcome.error;
+                writeRefused.store(true, memory_order_release);
+            }
+            // Nobody waits on batches this old any more
+            failedBatches.erase(failedBatches.begin(), failedBatches.lower_bound(batch - 1024));
+        }
+        finishedBatch = max(finishedBatch, batch);
+    }
+
+    // Caller holds registryLock. The writes are queued under one writeLock
+    // hold, so the writer picks them all up in the same batch, whose number
+    // is returned for waitForBatch.
+    long long queueWrites(const vector<PendingWrite> &writes)
+    {
+        unique_lock<mutex> guard(writeLock);
+        if (!writerRunning)
+        {
+            // Writer already shut down: apply synchronously
+            long long batch = nextBatch++;
+            guard.unlock();
+            BatchFailure outcome;
+            try
+            {
+                for (const PendingWrite &w : writes)
+                {
+                    bool written = false;
+                    outcome.published = false;
+                    applyWrites({w}, written, outcome.published);
+                    outcome.onDisk = outcome.onDisk || written;
+                }
+            }
+            catch (VersionConflictException &e)
+            {
+                outcome.error = e.what();
+                outcome.conflict = true;
+            }
+            catch (exception &e)
+            {
+                outcome.error = e.what();
+            }
+            guard.lock();
+            finishBatch(batch, outcome);
+            return batch;
+        }
+
+        // A group larger than the queue bound is let in once the queue is empty
+        queueNotFull.wait(guard, [this, &writes]
+                          { return pending.empty() || pending.size() + writes.size() <= maxPendingWrites; });
+        for (const PendingWrite &w : writes)
+            addPending(w);
+        writesQueued.notify_one();
+        return nextBatch;
+    }
+
+    // Blocks until the batch is written; returns true with its failure if it failed
+    bool waitForBatch(long long batch, BatchFailure &failure)
+    {
+        unique_lock<mutex> guard(writeLock);
+        writesDone.wait(guard, [this, batch]
+                        { return finishedBatch >= batch; });
+        auto it = failedBatches.find(batch);
+        if (it == failedBatches.end())
+            return false;
+        failure = it->second;
+        failedBatches.erase(it);
+        return true;
+    }
+
+    // Caller holds writeLock; coalesces with a write already queued for the
+    // id, which keeps the version that is on disk as its base
+    void addPending(const PendingWrite &write)
+    {
+        WriteKind kind = write.kind;
+        const Patient &p = write.patient;
+        auto it = pending.find(p.getId());
+        if (it == pending.end())
+        {
+            pending.emplace(p.getId(), write);
+            pendingOrder.push_back(p.getId());
+            return;
+        }
+
+        PendingWrite &w = it->second;
+        if (w.kind == WRITE_SAVE && kind == WRITE_DELETE)
+        {
+            // Registered and deleted before reaching disk: nothing to write
+            pending.erase(it);
+            pendingOrder.erase(find(pendingOrder.begin(), pendingOrder.end(), p.getId()));
+            queueNotFull.notify_one();
+            return;
+        }
+        if (w.kind == WRITE_SAVE)
+            kind = WRITE_SAVE;
+        else if (w.kind == WRITE_DELETE && kind == WRITE_SAVE)
+            kind = w.archived ? WRITE_SAVE : WRITE_UPDATE;
+        w.kind = kind;
+        w.patient = p;
+        // A move to the archive that hasn't been written yet leaves the
+        // record in patients.txt, so a delete after it still has to remove it
+        w.archived = write.archived && !w.movedToArchive;
+        w.movedToArchive = write.movedToArchive;
+    }
+
+    void writerLoop()
+    {
+        unique_lock<mutex> guard(writeLock);
+        while (true)
+        {
+            writesQueued.wait(guard, [this]
+                              { return !pendingOrder.empty() || !writerRunning; });
+            if (pendingOrder.empty())
+                return;
+
+            vector<PendingWrite> batch;
+            for (int id : pendingOrder)
+                batch.push_back(pending.at(id));
+            pending.clear();
+            pendingOrder.clear();
+            long long batchNumber = nextBatch++;
+            writing = true;
+            queueNotFull.notify_all();
+
+            guard.unlock();
+            BatchFailure outcome;
+            try
+            {
+                applyWrites(batch, outcome.onDisk, outcome.published);
+                if (journalEntries >= checkpointInterval)
+                    checkpointIfIdle();
+            }
+            catch (VersionConflictException &e)
+            {
+                outcome.error = e.what();
+                outcome.conflict = true;
+            }
+            catch (exception &e)
+            {
+                outcome.error = e.what();
+            }
+            guard.lock();
+
+            finishBatch(batchNumber, outcome);
+            writing = false;
+            writesDone.notify_all();
+        }
+    }
+
+    // onDisk is set once patients.txt holds the batch and published once the
+    // change feed does too; the journal is written last. Holds patients.lock
+    // throughout so other processes see whole batches, in the same order in
+    // every file.
+    void applyWrites(const vector<PendingWrite> &batch, bool &onDisk, bool &published)
+    {
+        FileLock fileGuard(patientLockFile);
+        bool appendOnly = true;
+        for (const PendingWrite &w : batch)
+            if (w.kind != WRITE_SAVE && !w.archived)
+                appendOnly = false;
+
+        if (appendOnly)
+        {
+            ofstream file(patientFile, ios::app);
+            if (!file)
+                throw FileOperationException("Could not open patient file");
+            for (const PendingWrite &w : batch)
+                if (!w.archived)
+                    file << RecordChecksum::seal(w.patient.toString(), w.patient.getVersion()) << "\n";
+            file.close();
+            // A short append leaves at most a torn last line, which fails its checksum
+            if (!file)
+                throw FileOperationException("Could not write patient file");
+            onDisk = true;
+            noteOwnWrite();
+            publishChanges(batch);
+            published = true;
+            appendJournal(batch);
+            return;
+        }
+
+        Patient *patients;
+        int count;
+        vector<string> corrupt;
+        readAllPatients(patients, count, &corrupt);
+
+        unordered_map<int, const PendingWrite *> byId;
+        for (const PendingWrite &w : batch)
+            byId[w.patient.getId()] = &w;
+
+        // Each update or delete must still find the version it replaces. If
+        // another process has written the record since, or removed it, the
+        // whole batch is refused. Version 0 on disk predates stored versions.
+        unordered_map<int, uint32_t> diskVersions;
+        for (int i = 0; i < count; i++)
+            diskVersions[patients[i].getId()] = patients[i].getVersion();
+        for (const PendingWrite &w : batch)
+        {
+            if (w.kind == WRITE_SAVE)
+                continue;
+            auto found = diskVersions.find(w.patient.getId());
+            bool removed = found == diskVersions.end();
+            if ((removed && w.kind == WRITE_UPDATE) || (!removed && found->second != 0 && found->second != w.baseVersion))
+            {
+                MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                throw VersionConflictException();
+            }
+        }
+
+        // Rewrite into a temp file and swap it in, so a failed pass leaves the
+        // previous patients.txt intact
+        string tempFile = string(patientFile) + ".tmp";
+        ofstream file(tempFile);
+        if (!file)
+        {
+            MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+            throw FileOperationException("Could not open patient file");
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            auto it = byId.find(patients[i].getId());
+            if (it == byId.end())
+                file << RecordChecksum::seal(patients[i].toString(), patients[i].getVersion()) << "\n";
+            else if (it->second->kind == WRITE_UPDATE)
+                file << RecordChecksum::seal(it->second->patient.toString(), it->second->patient.getVersion()) << "\n";
+        }
+        for (const PendingWrite &w : batch)
+            if (w.kind == WRITE_SAVE)
+                file << RecordChecksum::seal(w.patient.toString(), w.patient.getVersion()) << "\n";
+        file.close();
+        MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+        if (!file)
+        {
+            remove(tempFile.c_str());
+            throw FileOperationException("Could not write patient file");
+        }
+        // The rewrite drops damaged lines, so keep them where they can be recovered
+        quarantine(corrupt);
+        // rename replaces the old file in one step, so a crash leaves one or the other
+        if (rename(tempFile.c_str(), patientFile) != 0)
+            throw FileOperationException("Could not replace patient file");
+        onDisk = true;
+        noteOwnWrite();
+
+        publishChanges(batch);
+        published = true;
+        appendJournal(batch);
+    }
+
+    // Caller holds patients.lock, so nobody else can have written since
+    void noteOwnWrite()
+    {
+        lock_guard<mutex> guard(writeLock);
+        knownStamp = diskStamp();
+    }
+
+    void appendJournal(const vector<PendingWrite> &batch)
+    {
+        ofstream journal(journalFile, ios::app);
+        if (!journal)
+            throw FileOperationException("Could not open journal file");
+        for (const PendingWrite &w : batch)
+        {
+            if (w.kind == WRITE_DELETE)
+                journal << "D|" << w.patient.getId() << "\n";
+            else
+                journal << "U|" << w.patient.getVersion() << "|" << w.patient.toString() << "\n";
+        }
+        journal << "S|" << fileSize(patientFile) << "\n";
+        journalEntries += (int)batch.size();
+    }
+
+    void publishChanges(const vector<PendingWrite> &batch)
+    {
+        vector<string> entries;
+        for (const PendingWrite &w : batch)
+        {
+            // An archived patient is still there for readers, so consumers keep it
+            if (w.movedToArchive)
+                continue;
+            if (w.kind == WRITE_DELETE)
+                entries.push_back("D|" + to_string(w.patient.getId()));
+            else
+                entries.push_back((w.kind == WRITE_SAVE ? "R|" : "U|") + w.patient.toString());
+        }
+        changeFeed.append(entries);
+    }
+
+    // Lines that fail their checksum or don't parse are skipped and, if
+    // asked for, handed back in corrupt. Each patient carries the version
+    // stored with its line.
+    void readAllPatients(Patient *&patients, int &count, vector<string> *corrupt = nullptr)
+    {
+        ifstream file(patientFile);
+        vector<string> records;
+        vector<uint32_t> versions;
+        string line, record;
+        uint32_t version;
+        while (getline(file, line))
+        {
+            if (line.empty())
+                continue;
+            if (RecordChecksum::open(line, record, &version) == RecordChecksum::Corrupt)
+            {
+                if (corrupt)
+                    corrupt->push_back(line);
+                continue;
+            }
+            records.push_back(record);
+            versions.push_back(version);
+        }
+
+        count = (int)records.size();
+        patients = MemoryAccounting::newArray<Patient>(MEM_PATIENT_LISTS, count);
+        for (int i = 0; i < count; i++)
+        {
+            patients[i].fromString(records[i]);
+            patients[i].setVersion(versions[i]);
+        }
+    }
+
+    void loadPrescriptionFile()
+    {
+        ifstream file(prescriptionFile);
+        string line;
+        while (getline(file, line))
+        {
+            if (line.empty())
+                continue;
+            Prescription p;
+            if (!p.fromString(line))
+                continue;
+            prescriptions[p.patientId].push_back(p);
+            lastPrescriptionId = max(lastPrescriptionId, p.id);
+        }
+    }
+
+    void quarantine(const vector<string> &lines)
+    {
+        if (lines.empty())
+            return;
+        ofstream file(quarantineFile, ios::app);
+        for (const string &line : lines)
+            file << line << "\n";
+        if (!file)
+            throw FileOperationException("Could not write quarantine file");
+    }
+
+    void initializeAccessRights()
+    {
+        ofstream file(accessRightsFile);
+        if (!file)
+            throw FileOperationException("Could not create access rights file");
+        file << "Doctor|1|1|1\nReceptionist|1|1\n";
+    }
+
+public:
+    static FileHandler *getInstance()
+    {
+        if (!instance)
+            instance = new FileHandler();
+        return instance;
+    }
+
+    // Queue the mutation for the writer thread; returns as soon as it is queued
+    void savePatient(const Patient &p) override
+    {
+        enqueueWrite(WRITE_SAVE, p);
+        AuditTrail::getInstance()->record(AUDIT_REGISTER, p.getId());
+    }
+
+    void updatePatient(const Patient &p) override
+    {
+        enqueueWrite(WRITE_UPDATE, p);
+        AuditTrail::getInstance()->record(AUDIT_UPDATE, p.getId());
+    }
+
+    void deletePatient(int id) override
+    {
+        enqueueWrite(WRITE_DELETE, Patient(id));
+        AuditTrail::getInstance()->record(AUDIT_DELETE, id);
+    }
+
+    // Applies every operation or none. Covers active patients only; an update
+    // or delete of an unknown or archived id rejects the whole transaction.
+    // Waits for its own batch so that, if patients.txt never took it, the
+    // change can be undone in memory too.
+    void commit(Transaction &t) override
+    {
+        vector<PendingWrite> &writes = writesOf(t);
+        if (writes.empty())
+            return;
+
+        // What applyToRegistry may change for each id, to undo a failed write
+        struct Prior
+        {
+            unique_ptr<Patient> patient;
+            bool archived;
+            uint32_t block;
+            bool touched;
+            time_t touchedAt;
+        };
+        map<int, Prior> before;
+        long long batch;
+        {
+            lock_guard<mutex> registryGuard(registryLock);
+            refreshFromDisk();
+            for (const PendingWrite &w : writes)
+            {
+                int id = w.patient.getId();
+                if (before.count(id))
+                    continue;
+                const Patient *found = registry.find(id);
+                Prior &prior = before[id];
+                prior.patient = found ? unique_ptr<Patient>(new Patient(*found)) : nullptr;
+                prior.archived = !found && archiveFilter.mightContain(id) && archiveIds.find(id, prior.block);
+                auto touched = lastTouched.find(id);
+                prior.touched = touched != lastTouched.end();
+                prior.touchedAt = prior.touched ? touched->second : 0;
+            }
+
+            // Check against the state the transaction builds up as it goes.
+            // Updates must match the version from before the transaction;
+            // later updates of the same record inside it build on earlier ones.
+            unordered_map<int, bool> present;
+            for (auto &entry : before)
+                present[entry.first] = entry.second.patient != nullptr;
+            for (const PendingWrite &w : writes)
+            {
+                const unique_ptr<Patient> &original = before[w.patient.getId()].patient;
+                bool &exists = present[w.patient.getId()];
+                if (w.kind != WRITE_SAVE && !exists)
+                    throw PatientNotFoundException();
+                if (w.kind == WRITE_UPDATE && original && w.patient.getVersion() != original->getVersion())
+                    throw VersionConflictException();
+                exists = w.kind != WRITE_DELETE;
+            }
+
+            vector<PendingWrite> stamped = writes;
+            for (PendingWrite &w : stamped)
+            {
+                if (w.kind == WRITE_UPDATE)
+                    stampUpdate(w.patient, before[w.patient.getId()].patient.get(), registry.find(w.patient.getId()));
+                applyToRegistry(w);
+            }
+            batch = queueWrites(stamped);
+        }
+
+        BatchFailure failure;
+        bool failed = waitForBatch(batch, failure);
+        if (failed && failure.onDisk && !failure.published)
+        {
+            // patients.txt has the batch, so it stays, but replicas have not
+            // heard of it yet: not acknowledged. The feed lines are retried
+            // ahead of the next batch's.
+            writes.clear();
+            throw FileOperationException(failure.error.c_str());
+        }
+        // Once patients.txt and the feed have the batch it is committed; a
+        // later journal failure is left to flush() and shutdown() to report
+        if (failed && !failure.onDisk)
+        {
+            {
+                lock_guard<mutex> guard(writeLock);
+                if (writeError == failure.error)
+                    writeError.clear();
+                // Reported by the exception below, not at the next prompt
+                if (refusedError == failure.error)
+                {
+                    refusedError.clear();
+                    writeRefused.store(false, memory_order_relaxed);
+                }
+            }
+            lock_guard<mutex> registryGuard(registryLock);
+            for (auto &entry : before)
+            {
+                Prior &prior = entry.second;
+                if (prior.patient)
+                    registry.put(*prior.patient);
+                else
+                    registry.erase(entry.first);
+                uint32_t block;
+                if (prior.archived && !archiveIds.find(entry.first, block))
+                    archiveIds.insert(entry.first, prior.block);
+                if (prior.touched)
+                    lastTouched[entry.first] = prior.touchedAt;
+                else
+                    lastTouched.erase(entry.first);
+            }
+            writes.clear();
+            if (failure.conflict)
+                throw VersionConflictException();
+            throw FileOperationException(failure.error.c_str());
+        }
+
+        AuditAction actions[] = {AUDIT_REGISTER, AUDIT_UPDATE, AUDIT_DELETE};
+        for (const PendingWrite &w : writes)
+            AuditTrail::getInstance()->record(actions[w.kind], w.patient.getId());
+        writes.clear();
+    }
+
+    // Blocks until every queued mutation is on disk
+    void flush() override
+    {
+        unique_lock<mutex> guard(writeLock);
+        writesDone.wait(guard, [this]
+                        { return pendingOrder.empty() && !writing; });
+        if (!writeError.empty())
+        {
+            string error = writeError;
+            writeError.clear();
+            throw FileOperationException(error.c_str());
+        }
+    }
+
+    string takeWriteError() override
+    {
+        if (!writeRefused.load(memory_order_acquire))
+            return "";
+        string error;
+        {
+            lock_guard<mutex> guard(writeLock);
+            writeRefused.store(false, memory_order_relaxed);
+            error.swap(refusedError);
+            if (writeError == error)
+                writeError.clear();
+        }
+        lock_guard<mutex> registryGuard(registryLock);
+        refreshFromDisk();
+        return error;
+    }
+
+    // Durability barrier for process exit: drains the queue and stops the writer
+    void shutdown() override
+    {
+        {
+            unique_lock<mutex> guard(writeLock);
+            if (!writerRunning)
+                return;
+            writesDone.wait(guard, [this]
+                            { return pendingOrder.empty() && !writing; });
+            writerRunning = false;
+            if (!writeError.empty())
+                cout << "Error saving patient records: " << writeError << endl;
+        }
+        writesQueued.notify_all();
+        writer.join();
+
+        // Leave a fresh checkpoint so the next start skips the journal replay
+        try
+        {
+            lock_guard<mutex> registryGuard(registryLock);
+            saveActivity();
+            if (journalEntries > 0 && diskStamp() == knownStamp)
+                writeCheckpoint(buildCheckpoint(fileSize(patientFile)));
+            // Feed lines a failed batch still owes get one last try
+            changeFeed.append({});
+        }
+        catch (FileOperationException &e)
+        {
+            cout << e.what() << endl;
+        }
+    }
+
+    const char *getLoadSource() const override { return loadedFromCheckpoint ? "checkpoint" : "patients.txt"; }
+    double getStartupMillis() const override { return startupMillis; }
+    int getCorruptRecordCount() const override { return corruptRecords; }
+
+    int getPatientCount() override
+    {
+        lock_guard<mutex> guard(registryLock);
+        return (int)registry.size();
+    }
+
+    vector<int> findDuplicates(const Patient &candidate) override
+    {
+        lock_guard<mutex> guard(registryLock);
+        return registry.findDuplicates(candidate);
+    }
+
+    // Falls back to the archive for patients moved to the cold tier
+    Patient getPatient(int id) override
+    {
+        lock_guard<mutex> guard(registryLock);
+        if (const Patient *found = registry.find(id))
+            return *found;
+
+        Patient p;
+        if (!findArchivedPatient(id, p))
+            throw PatientNotFoundException();
+        return p;
+    }
+
+    // Marks a record as viewed so it stays in the hot tier
+    void touchPatient(int id) override
+    {
+        lock_guard<mutex> guard(registryLock);
+        if (registry.find(id))
+            lastTouched[id] = time(nullptr);
+    }
+
+    // Moves every patient not touched for the given number of days into the
+    // compressed archive and drops them from patients.txt. Returns the count.
+    int archiveInactivePatients(int days) override
+    {
+        lock_guard<mutex> registryGuard(registryLock);
+        time_t cutoff = time(nullptr) - (time_t)days * 24 * 60 * 60;
+
+        // A record with a write still queued stays hot: the move would
+        // coalesce with that write and keep it from the change feed
+        vector<int> ids;
+        {
+            lock_guard<mutex> guard(writeLock);
+            registry.forEach([&](const Patient &p)
+                             {
+                auto touched = lastTouched.find(p.getId());
+                if ((touched == lastTouched.end() || touched->second < cutoff) && !pending.count(p.getId()))
+                    ids.push_back(p.getId()); });
+        }
+        if (ids.empty())
+            return 0;
+
+        ofstream archive(archiveFile, ios::binary | ios::app);
+        ofstream index(archiveIndexFile, ios::app);
+        if (!archive || !index)
+            throw FileOperationException("Could not open patient archive");
+        // A line torn by an earlier crash is ended first, so it stays the only one skipped
+        ifstream lastLine(archiveIndexFile, ios::binary);
+        if (lastLine.seekg(-1, ios::end) && lastLine.get() != '\n')
+            index << "\n";
+        long long offset = fileSize(archiveFile);
+        if (offset < 0)
+            offset = 0;
+
+        size_t firstNewBlock = archiveBlocks.size();
+        // Registry iteration is in id order, so each block covers a narrow id range
+        for (size_t start = 0; start < ids.size(); start += archiveBlockRecords)
+        {
+            size_t end = min(ids.size(), start + archiveBlockRecords);
+            string raw;
+            for (size_t i = start; i < end; i++)
+                raw += registry.find(ids[i])->toString() + "\n";
+            string compressed = BlockCompressor::compress(raw);
+
+            ArchiveBlock block{ids[start], ids[end - 1], offset, (uint32_t)compressed.size(), (uint32_t)raw.size()};
+            archive.write(compressed.data(), (streamsize)compressed.size());
+            index << block.firstId << "|" << block.lastId << "|" << block.offset << "|"
+                  << block.compressedSize << "|" << block.rawSize << "\n";
+            archiveBlocks.push_back(block);
+            maxArchivedId = max(maxArchivedId, block.lastId);
+            offset += block.compressedSize;
+        }
+        archive.close();
+        index.close();
+        if (!archive || !index)
+            throw FileOperationException("Could not write patient archive");
+
+        for (size_t i = 0; i < ids.size(); i++)
+            archiveIds.insert(ids[i], (uint32_t)(firstNewBlock + i / archiveBlockRecords));
+        rebuildArchiveFilter();
+
+        vector<PendingWrite> removals;
+        for (int id : ids)
+        {
+            const Patient *found = registry.find(id);
+            removals.push_back({WRITE_DELETE, *found, found->getVersion(), false, true});
+            registry.erase(id);
+            lastTouched.erase(id);
+        }
+        queueWrites(removals);
+        saveActivity();
+        return (int)ids.size();
+    }
+
+    // Pins the registry as of now. Until endSnapshot, readSnapshot returns
+    // exactly that version of every record while writers keep committing.
+    long long beginSnapshot() override
+    {
+        lock_guard<mutex> guard(registryLock);
+        return registry.pin();
+    }
+
+    void endSnapshot(long long snapshot) override
+    {
+        lock_guard<mutex> guard(registryLock);
+        registry.unpin(snapshot);
+    }
+
+    // Appends the next chunk of a snapshot, resuming at fromId. Returns false
+    // once the whole snapshot has been read.
+    bool readSnapshot(long long snapshot, int &fromId, vector<Patient> &out) override
+    {
+        lock_guard<mutex> guard(registryLock);
+        return registry.read(snapshot, fromId, snapshotChunk, out);
+    }
+
+    // Consistent copy of every patient, read chunk by chunk so a large
+    // registry never holds off writers for the whole copy
+    void loadAllPatients(Patient *&patients, int &count) override
+    {
+        long long snapshot = beginSnapshot();
+        vector<Patient> all;
+        int fromId = INT_MIN;
+        while (readSnapshot(snapshot, fromId, all))
+            ;
+        endSnapshot(snapshot);
+
+        count = (int)all.size();
+        patients = MemoryAccounting::newArray<Patient>(MEM_PATIENT_LISTS, count);
+        for (int i = 0; i < count; i++)
+            patients[i] = all[i];
+    }
+
+    // Equality filter on an interned field: the text is looked up once and
+    // each record then costs one integer comparison
+    void findByDiagnosis(const char *diagnosis, Patient *&patients, int &count) override
+    {
+        vector<Patient> matches;
+        uint32_t handle;
+        if (StringPool::getInstance()->lookup(diagnosis, handle))
+        {
+            long long snapshot = beginSnapshot();
+            vector<Patient> chunk;
+            int fromId = INT_MIN;
+            bool more = true;
+            while (more)
+            {
+                more = readSnapshot(snapshot, fromId, chunk);
+                for (const Patient &p : chunk)
+                    if (p.getDiagnosisId() == handle)
+                        matches.push_back(p);
+                chunk.clear();
+            }
+            endSnapshot(snapshot);
+        }
+
+        count = (int)matches.size();
+        patients = MemoryAccounting::newArray<Patient>(MEM_PATIENT_LISTS, count);
+        for (int i = 0; i < count; i++)
+            patients[i] = matches[i];
+    }
+
+    // Each call hands out a fresh ID, so concurrent registrations never
+    // collide even before their records are saved
+    int getNextPatientId() override
+    {
+        lock_guard<mutex> guard(registryLock);
+        // Archived IDs stay reserved
+        int next = max(registry.maxId(), maxArchivedId) + 1;
+        lastIssuedId = max(next, lastIssuedId + 1);
+        return lastIssuedId;
+    }
+
+    bool *getAccessRights(const char *role, int &count) override
+    {
+        ifstream file(accessRightsFile);
+        if (!file)
+            throw FileOperationException("Could not open access rights file");
+
+        string line;
+        while (getline(file, line))
+        {
+            if (line.find(role) == 0)
+            {
+                stringstream ss(line);
+                string token;
+                count = 0;
+
+                getline(ss, token, '|'); // Skip role
+                while (getline(ss, token, '|'))
+                    count++;
+
+                bool *rights = MemoryAccounting::newArray<bool>(MEM_RIGHTS, count);
+                ss.clear();
+                ss.seekg(0);
+                getline(ss, token, '|'); // Skip role
+
+                for (int i = 0; i < count; i++)
+                {
+                    getline(ss, token, '|');
+                    rights[i] = (token == "1");
+                }
+
+                return rights;
+            }
+        }
+
+        throw FileOperationException("Role not found");
+    }
+
+    void updateAccessRights(const char *role, const bool *rights, int count) override
+    {
+        ifstream inFile(accessRightsFile);
+        if (!inFile)
+            throw FileOperationException("Could not open access rights file");
+
+        string content, line;
+        bool found = false;
+
+        while (getline(inFile, line))
+        {
+            if (line.find(role) == 0)
+            {
+                found = true;
+                line = role;
+                for (int i = 0; i < count; i++)
+                    line += "|" + string(rights[i] ? "1" : "0");
+            }
+            content += line + "\n";
+        }
+
+        if (!found)
+            throw FileOperationException("Role not found");
+
+        ofstream outFile(accessRightsFile);
+        if (!outFile)
+            throw FileOperationException("Could not open access rights file");
+        outFile << content;
+    }
+
+    void saveTriageQueue(const TriageEntry *entries, int count) override
+    {
+        ofstream file(triageFile);
+        if (!file)
+            throw FileOperationException("Could not open triage queue file");
+        for (int i = 0; i < count; i++)
+            file << entries[i].patientId << "|" << entries[i].priority << "|" << entries[i].seq << "\n";
+    }
+
+    void loadTriageQueue(TriageEntry *&entries, int &count) override
+    {
+        ifstream file(triageFile);
+        count = 0;
+
+        if (!file)
+        {
+            entries = new TriageEntry[0];
+            return;
+        }
+
+        string line;
+        while (getline(file, line))
+            if (!line.empty())
+                count++;
+        file.clear();
+        file.seekg(0);
+
+        // patientId|priority|seq; lines that don't parse are skipped
+        entries = new TriageEntry[count];
+        int loaded = 0;
+        while (loaded < count && getline(file, line))
+        {
+            size_t first = line.find('|'), second = first == string::npos ? first : line.find('|', first + 1);
+            if (second == string::npos)
+                continue;
+            Validated<int> patientId = InputValidator::parseNumber(line.substr(0, first), 1, INT_MAX);
+            Validated<int> priority = InputValidator::parseNumber(line.substr(first + 1, second - first - 1), 1, 5);
+            long long seq;
+            auto parsed = from_chars(line.data() + second + 1, line.data() + line.size(), seq);
+            if (!patientId.ok() || !priority.ok() || parsed.ec != errc() || parsed.ptr != line.data() + line.size())
+                continue;
+            entries[loaded++] = {patientId.value, priority.value, seq};
+        }
+        count = loaded;
+    }
+
+    void savePrescription(Prescription &p) override
+    {
+        lock_guard<mutex> guard(prescriptionLock);
+        p.id = ++lastPrescriptionId;
+        ofstream file(prescriptionFile, ios::app);
+        if (!(file << p.toString() << "\n"))
+        {
+            lastPrescriptionId--;
+            throw FileOperationException("Could not write prescription file");
+        }
+        prescriptions[p.patientId].push_back(p);
+    }
+
+    void loadPrescriptions(int patientId, Prescription *&out, int &count) override
+    {
+        lock_guard<mutex> guard(prescriptionLock);
+        auto it = prescriptions.find(patientId);
+        count = it == prescriptions.end() ? 0 : (int)it->second.size();
+        out = new Prescription[count];
+        for (int i = 0; i < count; i++)
+            out[i] = it->second[i];
+    }
+
+    void loadWardLayout(WardLayout *&layout, int &count) override
+    {
+        ifstream file(wardFile);
+        if (!file)
+        {
+            ofstream seed(wardFile);
+            for (const WardLayout &w : defaultWardLayout)
+                seed << w.ward << "|" << bedTypeNames[w.type] << "|" << w.beds << "\n";
+            if (!seed)
+                throw FileOperationException("Could not create ward layout file");
+            count = defaultWardLayoutCount;
+            layout = MemoryAccounting::newArray<WardLayout>(MEM_BEDS, count);
+            copy(defaultWardLayout, defaultWardLayout + count, layout);
+            return;
+        }
+
+        // ward|type|beds; lines that don't parse are skipped
+        vector<WardLayout> rows;
+        string line;
+        while (getline(file, line))
+        {
+            size_t first = line.find('|'), second = first == string::npos ? first : line.find('|', first + 1);
+            if (first == 0 || second == string::npos)
+                continue;
+            string typeName = line.substr(first + 1, second - first - 1);
+            int type = 0;
+            while (type < BED_TYPE_COUNT && typeName != bedTypeNames[type])
+                type++;
+            Validated<int> beds = InputValidator::parseNumber(line.substr(second + 1), 1, 1 << 20);
+            if (type < BED_TYPE_COUNT && beds.ok())
+                rows.push_back({line.substr(0, first), (BedType)type, beds.value});
+        }
+        count = (int)rows.size();
+        layout = MemoryAccounting::newArray<WardLayout>(MEM_BEDS, count);
+        copy(rows.begin(), rows.end(), layout);
+    }
+
+    void saveBedAssignment(const BedAssignment &change) override
+    {
+        lock_guard<mutex> guard(bedLock);
+        ofstream file(bedFile, ios::app);
+        if (!(file << change.ward << "|" << change.bed << "|" << change.patientId << "\n"))
+            throw FileOperationException("Could not write bed occupancy file");
+    }
+
+    // Replays beds.txt (ward|bed|patientId per change) and, once most of it
+    // is superseded history, rewrites it as just the occupied beds
+    void loadBedAssignments(BedAssignment *&assignments, int &count) override
+    {
+        lock_guard<mutex> guard(bedLock);
+        map<pair<string, int>, int> occupied;
+        int changes = 0;
+        {
+            ifstream file(bedFile);
+            string line;
+            while (getline(file, line))
+            {
+                size_t first = line.find('|'), second = first == string::npos ? first : line.find('|', first + 1);
+                if (second == string::npos)
+                    continue;
+                Validated<int> bed = InputValidator::parseNumber(line.substr(first + 1, second - first - 1), 1, INT_MAX);
+                Validated<int> patientId = InputValidator::parseNumber(line.substr(second + 1), 0, INT_MAX);
+                if (!bed.ok() || !patientId.ok())
+                    continue;
+                changes++;
+                pair<string, int> key(line.substr(0, first), bed.value);
+                if (patientId.value)
+                    occupied[key] = patientId.value;
+                else
+                    occupied.erase(key);
+            }
+        }
+
+        count = (int)occupied.size();
+        assignments = MemoryAccounting::newArray<BedAssignment>(MEM_BEDS, count);
+        int i = 0;
+        for (const auto &entry : occupied)
+            assignments[i++] = {entry.first.first, entry.first.second, entry.second};
+
+        if (changes > 2 * count + 64)
+        {
+            string temp = string(bedFile) + ".tmp";
+            {
+                ofstream file(temp, ios::trunc);
+                for (i = 0; i < count; i++)
+                    file << assignments[i].ward << "|" << assignments[i].bed << "|" << assignments[i].patientId << "\n";
+                if (!file)
+                    return;
+            }
+            // rename swaps the file in one step; if it fails, beds.txt is still whole
+            if (rename(temp.c_str(), bedFile) != 0)
+                remove(temp.c_str());
+        }
+    }
+};
+
+FileHandler *FileHandler::instance = nullptr;
+
+// Keeps patients, access rights and the triage queue in RAM only. Nothing
+// survives the process, which suits tests and engine-to-engine benchmarks.
+class MemoryStorageEngine : public StorageEngine
+{
+    mutex lock;
+    map<int, Patient> patients;
+    DuplicateDetector::Index duplicates; // blocks of patients, updated with it
+    map<string, vector<bool>> accessRights{{"Doctor", {true, true, true}}, {"Receptionist", {true, true}}};
+    vector<TriageEntry> triage;
+    map<pair<string, int>, int> beds;
+    unordered_map<int, vector<Prescription>> prescriptions;
+    int lastIssuedId = 0, lastPrescriptionId = 0;
+
+    // Caller holds lock. Same rules as FileHandler: saves start or bump the
+    // version, updates are compare-and-swap on it.
+    void apply(WriteKind kind, Patient p)
+    {
+        auto it = patients.find(p.getId());
+        if (kind == WRITE_SAVE)
+        {
+            p.setVersion(it != patients.end() ? it->second.getVersion() + 1 : 1);
+            patients[p.getId()] = p;
+            duplicates.add(p);
+        }
+        else if (it == patients.end())
+            throw PatientNotFoundException();
+        else if (kind == WRITE_UPDATE)
+        {
+            if (p.getVersion() != it->second.getVersion())
+                throw VersionConflictException();
+            p.setVersion(it->second.getVersion() + 1);
+            it->second = p;
+            duplicates.add(p);
+        }
+        else
+        {
+            patients.erase(it);
+            duplicates.remove(p.getId());
+        }
+    }
+
+public:
+    void savePatient(const Patient &p) override
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            apply(WRITE_SAVE, p);
+        }
+        AuditTrail::getInstance()->record(AUDIT_REGISTER, p.getId());
+    }
+
+    void updatePatient(const Patient &p) override
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            apply(WRITE_UPDATE, p);
+        }
+        AuditTrail::getInstance()->record(AUDIT_UPDATE, p.getId());
+    }
+
+    void deletePatient(int id) override
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            apply(WRITE_DELETE, Patient(id));
+        }
+        AuditTrail::getInstance()->record(AUDIT_DELETE, id);
+    }
+
+    // Updates are checked against the version from before the transaction;
+    // on any failure the touched records are put back as they were
+    void commit(Transaction &t) override
+    {
+        vector<PendingWrite> &writes = writesOf(t);
+        {
+            lock_guard<mutex> guard(lock);
+            map<int, unique_ptr<Patient>> before;
+            for (const PendingWrite &w : writes)
+            {
+                int id = w.patient.getId();
+                auto it = patients.find(id);
+                if (!before.count(id))
+                    before[id] = it != patients.end() ? unique_ptr<Patient>(new Patient(it->second)) : nullptr;
+            }
+
+            try
+            {
+                for (const PendingWrite &w : writes)
+                {
+                    Patient p = w.patient;
+                    if (w.kind == WRITE_UPDATE)
+                    {
+                        auto current = patients.find(p.getId());
+                        stampUpdate(p, before[p.getId()].get(), current != patients.end() ? &current->second : nullptr);
+                    }
+                    apply(w.kind, p);
+                }
+            }
+            catch (HospitalException &)
+            {
+                for (auto &entry : before)
+                {
+                    if (entry.second)
+                    {
+                        patients[entry.first] = *entry.second;
+                        duplicates.add(*entry.second);
+                    }
+                    else
+                    {
+                        patients.erase(entry.first);
+                        duplicates.remove(entry.first);
+                    }
+                }
+                throw;
+            }
+        }
+
+        AuditAction actions[] = {AUDIT_REGISTER, AUDIT_UPDATE, AUDIT_DELETE};
+        for (const PendingWrite &w : writes)
+            AuditTrail::getInstance()->record(actions[w.kind], w.patient.getId());
+        writes.clear();
+    }
+
+    void flush() override {}
+    void shutdown() override {}
+
+    Patient getPatient(int id) override
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = patients.find(id);
+        if (it == patients.end())
+            throw PatientNotFoundException();
+        return it->second;
+    }
+
+    int getPatientCount() override
+    {
+        lock_guard<mutex> guard(lock);
+        return (int)patients.size();
+    }
+
+    vector<int> findDuplicates(const Patient &candidate) override
+    {
+        lock_guard<mutex> guard(lock);
+        return duplicates.findMatches(candidate);
+    }
+
+    // No version history here, so a snapshot is only consistent within
+    // each chunk; writes between chunks show up in later ones
+    long long beginSnapshot() override { return 0; }
+    void endSnapshot(long long) override {}
+
+    bool readSnapshot(long long, int &fromId, vector<Patient> &out) override
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = patients.lower_bound(fromId);
+        for (size_t n = 0; it != patients.end() && n < 4096; ++it, ++n)
+            out.push_back(it->second);
+        if (it == patients.end())
+            return false;
+        fromId = it->first;
+        return true;
+    }
+
+    void loadAllPatients(Patient *&out, int &count) override
+    {
+        lock_guard<mutex> guard(lock);
+        count = (int)patients.size();
+        out = MemoryAccounting::newArray<Patient>(MEM_PATIENT_LISTS, count);
+        int i = 0;
+        for (auto &entry : patients)
+            out[i++] = entry.second;
+    }
+
+    void findByDiagnosis(const char *diagnosis, Patient *&out, int &count) override
+    {
+        vector<Patient> matches;
+        uint32_t handle;
+        if (StringPool::getInstance()->lookup(diagnosis, handle))
+        {
+            lock_guard<mutex> guard(lock);
+            for (auto &entry : patients)
+                if (entry.second.getDiagnosisId() == handle)
+                    matches.push_back(entry.second);
+        }
+
+        count = (int)matches.size();
+        out = MemoryAccounting::newArray<Patient>(MEM_PATIENT_LISTS, count);
+        for (int i = 0; i < count; i++)
+            out[i] = matches[i];
+    }
+
+    int getNextPatientId() override
+    {
+        lock_guard<mutex> guard(lock);
+        int next = patients.empty() ? 1 : patients.rbegin()->first + 1;
+        lastIssuedId = max(next, lastIssuedId + 1);
+        return lastIssuedId;
+    }
+
+    bool *getAccessRights(const char *role, int &count) override
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = accessRights.find(role);
+        if (it == accessRights.end())
+            throw FileOperationException("Role not found");
+        count = (int)it->second.size();
+        bool *rights = MemoryAccounting::newArray<bool>(MEM_RIGHTS, count);
+        for (int i = 0; i < count; i++)
+            rights[i] = it->second[i];
+        return rights;
+    }
+
+    void updateAccessRights(const char *role, const bool *rights, int count) override
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = accessRights.find(role);
+        if (it == accessRights.end())
+            throw FileOperationException("Role not found");
+        it->second.assign(rights, rights + count);
+    }
+
+    void saveTriageQueue(const TriageEntry *entries, int count) override
+    {
+        lock_guard<mutex> guard(lock);
+        triage.clear();
+        for (int i = 0; i < count; i++)
+            triage.push_back(entries[i]);
+    }
+
+    void loadTriageQueue(TriageEntry *&entries, int &count) override
+    {
+        lock_guard<mutex> guard(lock);
+        count = (int)triage.size();
+        entries = new TriageEntry[count];
+        for (int i = 0; i < count; i++)
+            entries[i] = triage[i];
+    }
+
+    void savePrescription(Prescription &p) override
+    {
+        lock_guard<mutex> guard(lock);
+        p.id = ++lastPrescriptionId;
+        prescriptions[p.patientId].push_back(p);
+    }
+
+    void loadPrescriptions(int patientId, Prescription *&out, int &count) override
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = prescriptions.find(patientId);
+        count = it == prescriptions.end() ? 0 : (int)it->second.size();
+        out = new Prescription[count];
+        for (int i = 0; i < count; i++)
+            out[i] = it->second[i];
+    }
+
+    void loadWardLayout(WardLayout *&layout, int &count) override
+    {
+        count = defaultWardLayoutCount;
+        layout = MemoryAccounting::newArray<WardLayout>(MEM_BEDS, count);
+        copy(defaultWardLayout, defaultWardLayout + count, layout);
+    }
+
+    void saveBedAssignment(const BedAssignment &change) override
+    {
+        lock_guard<mutex> guard(lock);
+        if (change.patientId)
+            beds[{change.ward, change.bed}] = change.patientId;
+        else
+            beds.erase({change.ward, change.bed});
+    }
+
+    void loadBedAssignments(BedAssignment *&assignments, int &count) override
+    {
+        lock_guard<mutex> guard(lock);
+        count = (int)beds.size();
+        assignments = MemoryAccounting::newArray<BedAssignment>(MEM_BEDS, count);
+        int i = 0;
+        for (const auto &entry : beds)
+            assignments[i++] = {entry.first.first, entry.first.second, entry.second};
+    }
+
+    const char *getLoadSource() const override { return "memory"; }
+};
+
+StorageEngine *StorageEngine::instance = nullptr;
+bool StorageEngine::inMemory = false;
+
+StorageEngine *StorageEngine::getInstance()
+{
+    if (!instance)
+    {
+        if (inMemory)
+            instance = new MemoryStorageEngine();
+        else
+            instance = FileHandler::getInstance();
+    }
+    return instance;
+}
+
+// What a staff member may do; each account carries a bitset of these
+enum Permission : uint32_t
+{
+    PERM_VIEW_PATIENTS = 1u << 0,
+    PERM_UPDATE_PATIENTS = 1u << 1,
+    PERM_DELETE_PATIENTS = 1u << 2,
+    PERM_REGISTER_PATIENTS = 1u << 3,
+    PERM_MANAGE_STAFF = 1u << 4,
+    PERM_ALL = (1u << 5) - 1
+};
+
+constexpr const char *permissionNames[] = {"View patients", "Update patients", "Delete patients",
+                                           "Register patients", "Manage staff"};
+constexpr int permissionCount = sizeof permissionNames / sizeof permissionNames[0];
+
+// FIPS 180-4 SHA-256, used for password hashing
+class Sha256
+{
+    uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t block[64];
+    size_t used = 0;
+    uint64_t length = 0;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress()
+    {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+            w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+        for (int i = 16; i < 64; i++)
+        {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+public:
+    void update(const void *data, size_t size)
+    {
+        const uint8_t *bytes = (const uint8_t *)data;
+        length += size;
+        while (size)
+        {
+            size_t take = min(size, sizeof block - used);
+            memcpy(block + used, bytes, take);
+            used += take;
+            bytes += take;
+            size -= take;
+            if (used == sizeof block)
+            {
+                compress();
+                used = 0;
+            }
+        }
+    }
+
+    void finish(uint8_t digest[32])
+    {
+        uint64_t bits = length * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (used != 56)
+            update(&pad, 1);
+        for (int i = 7; i >= 0; i--)
+            block[used++] = (uint8_t)(bits >> (8 * i));
+        compress();
+        for (int i = 0; i < 32; i++)
+            digest[i] = (uint8_t)(state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+};
+
+// Staff accounts, one line each in staff.txt:
+//   username|role|permissions|rounds|salt|hash
+// Passwords are stored as an iterated, salted SHA-256 so a stolen file does
+// not give them away. Accounts are indexed by username in a hash map, so
+// login cost does not grow with the number of staff. A missing file is
+// seeded with the three original role logins.
+class StaffDirectory
+{
+    static StaffDirectory *instance;
+    static thread_local uint32_t sessionPermissions;
+    const char *staffFile = "staff.txt";
+    static const int hashRounds = 10000;
+    static const size_t saltSize = 16, hashSize = 32;
+
+    struct Account
+    {
+        string role;
+        uint32_t permissions;
+        int rounds;
+        string salt, hash; // raw bytes
+    };
+
+    unordered_map<string, Account> accounts;
+    mutex lock;
+
+    static string hashPassword(const string &password, const string &salt, int rounds)
+    {
+        uint8_t digest[hashSize];
+        Sha256 first;
+        first.update(salt.data(), salt.size());
+        first.update(password.data(), password.size());
+        first.finish(digest);
+        for (int i = 1; i < rounds; i++)
+        {
+            Sha256 next;
+            next.update(digest, sizeof digest);
+            next.update(password.data(), password.size());
+            next.finish(digest);
+        }
+        return string((const char *)digest, sizeof digest);
+    }
+
+    static string toHex(const string &bytes)
+    {
+        static const char digits[] = "0123456789abcdef";
+        string hex;
+        for (unsigned char c : bytes)
+        {
+            hex += digits[c >> 4];
+            hex += digits[c & 15];
+        }
+        return hex;
+    }
+
+    static string fromHex(const string &hex)
+    {
+        string bytes;
+        for (size_t i = 0; i + 1 < hex.size(); i += 2)
+            bytes += (char)strtol(hex.substr(i, 2).c_str(), nullptr, 16);
+        return bytes;
+    }
+
+    // Only the admin menu offers staff management, so the bit counts on
+    // Admin accounts alone
+    static bool canManageStaff(const Account &account)
+    {
+        return account.role == "Admin" && (account.permissions & PERM_MANAGE_STAFF);
+    }
+
+    // Requires lock
+    bool isLastManager(const string &username)
+    {
+        int managers = 0;
+        for (const auto &entry : accounts)
+            managers += canManageStaff(entry.second);
+        return managers == 1 && canManageStaff(accounts[username]);
+    }
+
+    static Account makeAccount(const string &role, uint32_t permissions, const string &password)
+    {
+        random_device random;
+        string salt;
+        for (size_t i = 0; i < saltSize; i++)
+            salt += (char)(random() & 0xFF);
+        return {role, permissions, hashRounds, salt, hashPassword(password, salt, hashRounds)};
+    }
+
+    // Rewrites the whole file; staff changes are rare next to logins
+    void save()
+    {
+        string tempFile = string(staffFile) + ".tmp";
+        {
+            ofstream file(tempFile);
+            if (!file)
+                throw FileOperationException("Could not write staff file");
+            for (const auto &entry : accounts)
+            {
+                const Account &account = entry.second;
+                file << entry.first << '|' << account.role << '|' << hex << account.permissions << dec << '|'
+                     << account.rounds << '|' << toHex(account.salt) << '|' << toHex(account.hash) << '\n';
+            }
+            if (!file.flush())
+                throw FileOperationException("Could not write staff file");
+        }
+        if (rename(tempFile.c_str(), staffFile) != 0)
+            throw FileOperationException("Could not replace staff file");
+    }
+
+    StaffDirectory()
+    {
+        ifstream file(staffFile);
+        if (!file)
+        {
+            accounts["Admin"] = makeAccount("Admin", defaultPermissions("Admin"), "admin");
+            accounts["Doctor"] = makeAccount("Doctor", defaultPermissions("Doctor"), "doctor");
+            accounts["Receptionist"] = makeAccount("Receptionist", defaultPermissions("Receptionist"), "receptionist");
+            save();
+            return;
+        }
+
+        string line;
+        while (getline(file, line))
+        {
+            stringstream ss(line);
+            string username, role, permissions, rounds, salt, hash;
+            if (!getline(ss, username, '|') || !getline(ss, role, '|') || !getline(ss, permissions, '|') ||
+                !getline(ss, rounds, '|') || !getline(ss, salt, '|') || !getline(ss, hash))
+                continue;
+            Account account{role, (uint32_t)strtoul(permissions.c_str(), nullptr, 16), atoi(rounds.c_str()),
+                            fromHex(salt), fromHex(hash)};
+            if (isRole(role) && account.rounds > 0 && account.hash.size() == hashSize)
+                accounts[username] = account;
+        }
+    }
+
+public:
+    static StaffDirectory *getInstance()
+    {
+        if (!instance)
+            instance = new StaffDirectory();
+        return instance;
+    }
+
+    static bool isRole(const string &role) { return role == "Admin" || role == "Doctor" || role == "Receptionist"; }
+
+    static uint32_t defaultPermissions(const string &role)
+    {
+        if (role == "Admin")
+            return PERM_ALL;
+        if (role == "Doctor")
+            return PERM_VIEW_PATIENTS | PERM_UPDATE_PATIENTS | PERM_DELETE_PATIENTS;
+        return PERM_VIEW_PATIENTS | PERM_REGISTER_PATIENTS;
+    }
+
+    // The per-role switches in access_rights.txt, in the order the admin
+    // menu lists them, narrow what every account of that role may do
+    static uint32_t rolePermissions(const string &role)
+    {
+        static const map<string, vector<Permission>> switches = {
+            {"Doctor", {PERM_VIEW_PATIENTS, PERM_UPDATE_PATIENTS, PERM_DELETE_PATIENTS}},
+            {"Receptionist", {PERM_VIEW_PATIENTS, PERM_REGISTER_PATIENTS}}};
+        auto it = switches.find(role);
+        if (it == switches.end())
+            return PERM_ALL;
+
+        int count;
+        bool *rights = StorageEngine::getInstance()->getAccessRights(role.c_str(), count);
+        uint32_t allowed = PERM_ALL;
+        for (int i = 0; i < count && i < (int)it->second.size(); i++)
+            if (!rights[i])
+                allowed &= ~it->second[i];
+        MemoryAccounting::deleteArray(MEM_RIGHTS, rights, count);
+        return allowed;
+    }
+
+    // Permissions of the account logged in on this thread
+    static void setSessionPermissions(uint32_t permissions) { sessionPermissions = permissions; }
+    static bool allows(Permission permission) { return (sessionPermissions & permission) != 0; }
+
+    // Returns the account's effective permissions and sets role
+    uint32_t authenticate(const string &username, const string &password, string &role)
+    {
+        Account account;
+        {
+            lock_guard<mutex> guard(lock);
+            auto it = accounts.find(username);
+            if (it == accounts.end())
+                throw InvalidCredentialsException();
+            account = it->second;
+        }
+
+        // Compare every byte so the time taken does not reveal a matching prefix
+        string hash = hashPassword(password, account.salt, account.rounds);
+        unsigned char difference = hash.size() != account.hash.size();
+        for (size_t i = 0; i < hash.size() && i < account.hash.size(); i++)
+            difference |= hash[i] ^ account.hash[i];
+        if (difference)
+            throw InvalidCredentialsException();
+
+        role = account.role;
+        return account.permissions & rolePermissions(role);
+    }
+
+    // Returns false if the username is taken
+    bool addAccount(const string &username, const string &role, const string &password)
+    {
+        Account account = makeAccount(role, defaultPermissions(role), password);
+        lock_guard<mutex> guard(lock);
+        if (!accounts.emplace(username, account).second)
+            return false;
+        save();
+        return true;
+    }
+
+    // Refuses to remove the last Admin account that can manage staff
+    bool removeAccount(const string &username)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = accounts.find(username);
+        if (it == accounts.end() || isLastManager(username))
+            return false;
+        accounts.erase(it);
+        save();
+        return true;
+    }
+
+    bool setPassword(const string &username, const string &password)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = accounts.find(username);
+        if (it == accounts.end())
+            return false;
+        it->second = makeAccount(it->second.role, it->second.permissions, password);
+        save();
+        return true;
+    }
+
+    bool getPermissions(const string &username, uint32_t &permissions)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = accounts.find(username);
+        if (it == accounts.end())
+            return false;
+        permissions = it->second.permissions;
+        return true;
+    }
+
+    // Refuses to take staff management away from the last Admin account that has it
+    bool setPermissions(const string &username, uint32_t permissions)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = accounts.find(username);
+        if (it == accounts.end() || (!(permissions & PERM_MANAGE_STAFF) && isLastManager(username)))
+            return false;
+        it->second.permissions = permissions & PERM_ALL;
+        save();
+        return true;
+    }
+
+    // (username, role) pairs sorted by username
+    vector<pair<string, string>> list()
+    {
+        lock_guard<mutex> guard(lock);
+        vector<pair<string, string>> result;
+        for (const auto &entry : accounts)
+            result.emplace_back(entry.first, entry.second.role);
+        sort(result.begin(), result.end());
+        return result;
+    }
+};
+
+StaffDirectory *StaffDirectory::instance = nullptr;
+thread_local uint32_t StaffDirectory::sessionPermissions = 0;
+
+// Waiting-room queue ordered by priority (higher first), then arrival order.
+// Indexed binary heap: position[] tracks each patient's slot so priority
+// changes and removals are O(log n) instead of a linear search.
+class TriageQueue
+{
+    static TriageQueue *instance;
+    vector<TriageEntry> heap;
+    unordered_map<int, size_t> position;
+    long long nextSeq = 0, version = 0, persistedVersion = 0;
+    mutex heapLock, fileLock;
+
+    TriageQueue()
+    {
+        TriageEntry *entries;
+        int count;
+        StorageEngine::getInstance()->loadTriageQueue(entries, count);
+        for (int i = 0; i < count; i++)
+        {
+            if (position.count(entries[i].patientId))
+                continue;
+            heap.push_back(entries[i]);
+            position[entries[i].patientId] = heap.size() - 1;
+            siftUp(heap.size() - 1);
+            if (entries[i].seq >= nextSeq)
+                nextSeq = entries[i].seq + 1;
+        }
+        delete[] entries;
+    }
+
+    static bool before(const TriageEntry &a, const TriageEntry &b)
+    {
+        return a.priority != b.priority ? a.priority > b.priority : a.seq < b.seq;
+    }
+
+    void swapEntries(size_t i, size_t j)
+    {
+        swap(heap[i], heap[j]);
+        position[heap[i].patientId] = i;
+        position[heap[j].patientId] = j;
+    }
+
+    void siftUp(size_t i)
+    {
+        while (i > 0 && before(heap[i], heap[(i - 1) / 2]))
+        {
+            swapEntries(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void siftDown(size_t i)
+    {
+        while (true)
+        {
+            size_t best = i, left = 2 * i + 1, right = 2 * i + 2;
+            if (left < heap.size() && before(heap[left], heap[best]))
+                best = left;
+            if (right < heap.size() && before(heap[right], heap[best]))
+                best = right;
+            if (best == i)
+                return;
+            swapEntries(i, best);
+            i = best;
+        }
+    }
+
+    void removeAt(size_t i)
+    {
+        position.erase(heap[i].patientId);
+        if (i != heap.size() - 1)
+        {
+            heap[i] = heap.back();
+            position[heap[i].patientId] = i;
+            heap.pop_back();
+            siftDown(i);
+            siftUp(i);
+        }
+        else
+            heap.pop_back();
+    }
+
+    // Called with heapLock held; copies the heap so the file write happens
+    // outside it and never stalls enqueuers or the doctor's dequeue.
+    vector<TriageEntry> snapshot(long long &snapshotVersion)
+    {
+        snapshotVersion = ++version;
+        return heap;
+    }
+
+    void persist(const vector<TriageEntry> &entries, long long snapshotVersion)
+    {
+        lock_guard<mutex> guard(fileLock);
+        // A newer snapshot may already be on disk
+        if (snapshotVersion <= persistedVersion)
+            return;
+        StorageEngine::getInstance()->saveTriageQueue(entries.data(), (int)entries.size());
+        persistedVersion = snapshotVersion;
+    }
+
+public:
+    static TriageQueue *getInstance()
+    {
+        if (!instance)
+            instance = new TriageQueue();
+        return instance;
+    }
+
+    // Adds the patient, or changes their priority if already waiting
+    void enqueue(int patientId, int priority)
+    {
+        vector<TriageEntry> entries;
+        long long snapshotVersion;
+        {
+            lock_guard<mutex> guard(heapLock);
+            auto it = position.find(patientId);
+            if (it != position.end())
+            {
+                size_t i = it->second;
+                heap[i].priority = priority;
+                siftDown(i);
+                siftUp(i);
+            }
+            else
+            {
+                heap.push_back({patientId, priority, nextSeq++});
+                position[patientId] = heap.size() - 1;
+                siftUp(heap.size() - 1);
+            }
+            entries = snapshot(snapshotVersion);
+        }
+        persist(entries, snapshotVersion);
+    }
+
+    bool dequeue(TriageEntry &next)
+    {
+        vector<TriageEntry> entries;
+        long long snapshotVersion;
+        {
+            lock_guard<mutex> guard(heapLock);
+            if (heap.empty())
+                return false;
+            next = heap[0];
+            removeAt(0);
+            entries = snapshot(snapshotVersion);
+        }
+        persist(entries, snapshotVersion);
+        return true;
+    }
+
+    bool remove(int patientId)
+    {
+        vector<TriageEntry> entries;
+        long long snapshotVersion;
+        {
+            lock_guard<mutex> guard(heapLock);
+            auto it = position.find(patientId);
+            if (it == position.end())
+                return false;
+            removeAt(it->second);
+            entries = snapshot(snapshotVersion);
+        }
+        persist(entries, snapshotVersion);
+        return true;
+    }
+
+    int size()
+    {
+        lock_guard<mutex> guard(heapLock);
+        return (int)heap.size();
+    }
+};
+
+TriageQueue *TriageQueue::instance = nullptr;
+
+// Bit set per slot with summary levels on top: a bit in level k + 1 is set
+// while word k of the level below has any bit set. Finding the first set
+// slot is one count-trailing-zeros per level, which is two up to 4096 slots
+// and three up to 262144.
+class HierarchicalBitmap
+{
+    vector<vector<uint64_t>> levels; // levels[0] has one bit per slot
+
+public:
+    // Sizes the bitmap with every slot set
+    void reset(int slots)
+    {
+        levels.clear();
+        int bits = slots;
+        do
+        {
+            vector<uint64_t> words((size_t)(bits + 63) / 64, ~0ULL);
+            if (bits % 64)
+                words.back() = (1ULL << (bits % 64)) - 1;
+            levels.push_back(move(words));
+            bits = (int)levels.back().size();
+        } while (bits > 1);
+    }
+
+    bool test(int slot) const { return levels[0][slot / 64] >> (slot % 64) & 1; }
+
+    void set(int slot)
+    {
+        for (vector<uint64_t> &level : levels)
+        {
+            uint64_t &word = level[slot / 64];
+            bool wasEmpty = word == 0;
+            word |= 1ULL << (slot % 64);
+            if (!wasEmpty)
+                return;
+            slot /= 64;
+        }
+    }
+
+    void clear(int slot)
+    {
+        for (vector<uint64_t> &level : levels)
+        {
+            uint64_t &word = level[slot / 64];
+            word &= ~(1ULL << (slot % 64));
+            if (word)
+                return;
+            slot /= 64;
+        }
+    }
+
+    // Lowest set slot, or -1 when none is set
+    int findFirst() const
+    {
+        if (levels.back().empty() || !levels.back()[0])
+            return -1;
+        int slot = 0;
+        for (size_t k = levels.size(); k-- > 0;)
+            slot = slot * 64 + __builtin_ctzll(levels[k][slot]);
+        return slot;
+    }
+
+    int count() const
+    {
+        int total = 0;
+        for (uint64_t word : levels[0])
+            total += __builtin_popcountll(word);
+        return total;
+    }
+};
+
+// Which patient is in which bed. Beds come from the storage engine's ward
+// layout in groups of one ward and type, and each group tracks its free
+// beds in a HierarchicalBitmap, so a free bed is found in a few
+// instructions however many beds there are. Admissions and discharges are
+// written through the storage engine before they take effect.
+class BedBoard
+{
+    static BedBoard *instance;
+
+    struct Group
+    {
+        int ward;
+        BedType type;
+        int firstBed, beds;
+        HierarchicalBitmap free;
+    };
+
+    struct Bed
+    {
+        int ward, number, group, patientId;
+    };
+
+    vector<string> wards;
+    vector<vector<int>> wardBeds; // ward -> bed index by bed number - 1
+    vector<Group> groups;
+    vector<Bed> beds;
+    unordered_map<int, int> bedOfPatient;
+    mutex lock;
+
+    BedBoard()
+    {
+        StorageEngine *fh = StorageEngine::getInstance();
+        WardLayout *layout;
+        int count;
+        fh->loadWardLayout(layout, count);
+        for (int i = 0; i < count; i++)
+        {
+            int ward = findWard(layout[i].ward);
+            if (ward < 0)
+            {
+                ward = (int)wards.size();
+                wards.push_back(layout[i].ward);
+                wardBeds.emplace_back();
+            }
+            groups.push_back({ward, layout[i].type, (int)beds.size(), layout[i].beds, {}});
+            groups.back().free.reset(layout[i].beds);
+            for (int b = 0; b < layout[i].beds; b++)
+            {
+                wardBeds[ward].push_back((int)beds.size());
+                beds.push_back({ward, (int)wardBeds[ward].size(), (int)groups.size() - 1, 0});
+            }
+        }
+        MemoryAccounting::deleteArray(MEM_BEDS, layout, count);
+
+        BedAssignment *assignments;
+        fh->loadBedAssignments(assignments, count);
+        for (int i = 0; i < count; i++)
+        {
+            // Beds no longer in the layout are dropped
+            int ward = findWard(assignments[i].ward), number = assignments[i].bed;
+            if (ward < 0 || number > (int)wardBeds[ward].size() || bedOfPatient.count(assignments[i].patientId))
+                continue;
+            occupy(wardBeds[ward][number - 1], assignments[i].patientId);
+        }
+        MemoryAccounting::deleteArray(MEM_BEDS, assignments, count);
+    }
+
+    void occupy(int bed, int patientId)
+    {
+        Bed &b = beds[bed];
+        b.patientId = patientId;
+        groups[b.group].free.clear(bed - groups[b.group].firstBed);
+        bedOfPatient[patientId] = bed;
+    }
+
+    void release(int bed)
+    {
+        Bed &b = beds[bed];
+        bedOfPatient.erase(b.patientId);
+        b.patientId = 0;
+        groups[b.group].free.set(bed - groups[b.group].firstBed);
+    }
+
+    int findFreeLocked(int ward, int type) const
+    {
+        for (const Group &g : groups)
+            if ((ward < 0 || g.ward == ward) && (type < 0 || g.type == type))
+            {
+                int slot = g.free.findFirst();
+                if (slot >= 0)
+                    return g.firstBed + slot;
+            }
+        return -1;
+    }
+
+public:
+    struct Occupancy
+    {
+        int ward;
+        BedType type;
+        int beds, free;
+    };
+
+    static BedBoard *getInstance()
+    {
+        if (!instance)
+            instance = new BedBoard();
+        return instance;
+    }
+
+    int getWardCount() const { return (int)wards.size(); }
+    const string &getWardName(int ward) const { return wards[ward]; }
+
+    int findWard(const string &name) const
+    {
+        for (size_t w = 0; w < wards.size(); w++)
+            if (wards[w] == name)
+                return (int)w;
+        return -1;
+    }
+
+    string label(int bed) const { return wards[beds[bed].ward] + " bed " + to_string(beds[bed].number); }
+    BedType getType(int bed) const { return groups[beds[bed].group].type; }
+
+    // First free bed in ward of type, either -1 for any, or -1 if all are taken
+    int findFreeBed(int ward, int type)
+    {
+        lock_guard<mutex> guard(lock);
+        return findFreeLocked(ward, type);
+    }
+
+    // Bed the patient is in, or -1
+    int findPatient(int patientId)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = bedOfPatient.find(patientId);
+        return it == bedOfPatient.end() ? -1 : it->second;
+    }
+
+    // Puts the patient in the first free bed matching ward and type (-1 for
+    // any) and returns it; returns -1 and sets error if that is not possible
+    int admit(int patientId, int ward, int type, string &error)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = bedOfPatient.find(patientId);
+        if (it != bedOfPatient.end())
+        {
+            error = "Patient is already in " + label(it->second);
+            return -1;
+        }
+        int bed = findFreeLocked(ward, type);
+        if (bed < 0)
+        {
+            error = "No free bed matches";
+            return -1;
+        }
+        StorageEngine::getInstance()->saveBedAssignment({wards[beds[bed].ward], beds[bed].number, patientId});
+        occupy(bed, patientId);
+        return bed;
+    }
+
+    // Frees the patient's bed; false if they were not admitted
+    bool discharge(int patientId)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = bedOfPatient.find(patientId);
+        if (it == bedOfPatient.end())
+            return false;
+        int bed = it->second;
+        StorageEngine::getInstance()->saveBedAssignment({wards[beds[bed].ward], beds[bed].number, 0});
+        release(bed);
+        return true;
+    }
+
+    // Beds and free beds per ward and type, in layout order
+    vector<Occupancy> occupancy()
+    {
+        lock_guard<mutex> guard(lock);
+        vector<Occupancy> rows;
+        for (const Group &g : groups)
+        {
+            auto row = find_if(rows.begin(), rows.end(), [&g](const Occupancy &r)
+                               { return r.ward == g.ward && r.type == g.type; });
+            if (row == rows.end())
+                row = rows.insert(rows.end(), {g.ward, g.type, 0, 0});
+            row->beds += g.beds;
+            row->free += g.free.count();
+        }
+        return rows;
+    }
+};
+
+BedBoard *BedBoard::instance = nullptr;
+
+// Filter expressions over the registry, such as
+//   age > 65 AND gender = F AND diagnosis contains diabetes
+// A query is a conjunction of <field> <op> <value> conditions; values with
+// spaces go in double quotes. Fields are id, age, gender, name, address,
+// contact and diagnosis. Numbers take = != < <= > >=; text takes =, != and
+// contains, which ignores case. Compiling splits the conditions into
+// integer column tests, run first over a whole batch 16 rows at a time,
+// and text tests, run cheapest first over the rows that survive.
+class PatientQuery
+{
+    enum Field
+    {
+        FIELD_ID,
+        FIELD_AGE,
+        FIELD_GENDER,
+        FIELD_NAME,
+        FIELD_ADDRESS,
+        FIELD_CONTACT,
+        FIELD_DIAGNOSIS
+    };
+
+    enum Op
+    {
+        OP_EQ,
+        OP_NE,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+        OP_CONTAINS
+    };
+
+    struct Token
+    {
+        string text;
+        bool quoted;
+    };
+
+    // field op operand over an int32 column; gender counts as its character
+    struct ColumnTest
+    {
+        Field field;
+        bool acceptLess, acceptEqual, acceptGreater;
+        int32_t operand;
+    };
+
+    struct TextTest
+    {
+        Field field;
+        bool negate, contains;
+        string text;     // lower-cased for contains
+        uint32_t handle; // interned fields only
+        int cost;
+        unordered_map<uint32_t, bool> seen; // contains on interned fields, by handle
+    };
+
+    vector<ColumnTest> columnTests;
+    vector<TextTest> textTests;
+    bool matchesNothing = false;
+
+    static bool tokenize(const string &text, vector<Token> &tokens, string &error)
+    {
+        size_t i = 0;
+        while (i < text.size())
+        {
+            char c = text[i];
+            if (isspace((unsigned char)c))
+                i++;
+            else if (c == '"')
+            {
+                size_t close = text.find('"', i + 1);
+                if (close == string::npos)
+                {
+                    error = "Missing closing quote";
+                    return false;
+                }
+                tokens.push_back({text.substr(i + 1, close - i - 1), true});
+                i = close + 1;
+            }
+            else if (strchr("=!<>", c))
+            {
+                size_t length = i + 1 < text.size() && strchr("=>", text[i + 1]) ? 2 : 1;
+                tokens.push_back({text.substr(i, length), false});
+                i += length;
+            }
+            else
+            {
+                size_t start = i;
+                while (i < text.size() && !isspace((unsigned char)text[i]) && !strchr("=!<>\"", text[i]))
+                    i++;
+                tokens.push_back({text.substr(start, i - start), false});
+            }
+        }
+        return true;
+    }
+
+    static string lower(string text)
+    {
+        transform(text.begin(), text.end(), text.begin(), ::tolower);
+        return text;
+    }
+
+    static bool parseField(const string &word, Field &field)
+    {
+        static const char *names[] = {"id", "age", "gender", "name", "address", "contact", "diagnosis"};
+        for (int f = 0; f <= FIELD_DIAGNOSIS; f++)
+            if (lower(word) == names[f])
+            {
+                field = (Field)f;
+                return true;
+            }
+        return false;
+    }
+
+    static bool parseOp(const Token &token, Op &op)
+    {
+        static const char *symbols[] = {"=", "!=", "<", "<=", ">", ">="};
+        if (token.quoted)
+            return false;
+        if (token.text == "==" || token.text == "<>")
+        {
+            op = token.text == "==" ? OP_EQ : OP_NE;
+            return true;
+        }
+        if (lower(token.text) == "contains")
+        {
+            op = OP_CONTAINS;
+            return true;
+        }
+        for (int o = 0; o <= OP_GE; o++)
+            if (token.text == symbols[o])
+            {
+                op = (Op)o;
+                return true;
+            }
+        return false;
+    }
+
+    static bool containsIgnoreCase(const char *haystack, const string &needle)
+    {
+        for (; *haystack; haystack++)
+        {
+            size_t i = 0;
+            while (i < needle.size() && haystack[i] && tolower((unsigned char)haystack[i]) == needle[i])
+                i++;
+            if (i == needle.size())
+                return true;
+        }
+        return needle.empty();
+    }
+
+    bool addCondition(Field field, Op op, const string &value, string &error)
+    {
+        bool numeric = field == FIELD_ID || field == FIELD_AGE || field == FIELD_GENDER;
+        if (numeric)
+        {
+            if (op == OP_CONTAINS || (field == FIELD_GENDER && op != OP_EQ && op != OP_NE))
+            {
+                error = "Operator not supported for this field";
+                return false;
+            }
+            int32_t operand;
+            if (field == FIELD_GENDER)
+            {
+                Validated<char> gender = InputValidator::parseGender(value);
+                if (!gender.ok())
+                {
+                    error = "Gender must be M, F or O";
+                    return false;
+                }
+                operand = gender.value;
+            }
+            else
+            {
+                Validated<int> number = InputValidator::parseNumber(value, 0, INT_MAX);
+                if (!number.ok())
+                {
+                    error = "Expected a number after " + string(field == FIELD_ID ? "id" : "age");
+                    return false;
+                }
+                operand = number.value;
+            }
+            columnTests.push_back({field, op == OP_NE || op == OP_LT || op == OP_LE,
+                                   op == OP_EQ || op == OP_LE || op == OP_GE,
+                                   op == OP_NE || op == OP_GT || op == OP_GE, operand});
+            return true;
+        }
+
+        if (op != OP_EQ && op != OP_NE && op != OP_CONTAINS)
+        {
+            error = "Text fields take =, != or contains";
+            return false;
+        }
+        bool interned = field == FIELD_ADDRESS || field == FIELD_DIAGNOSIS;
+        TextTest test{field, op == OP_NE, op == OP_CONTAINS, op == OP_CONTAINS ? lower(value) : value, 0, 0, {}};
+        if (interned && !test.contains && !StringPool::getInstance()->lookup(value.c_str(), test.handle))
+        {
+            // No record can hold a value that was never interned
+            if (!test.negate)
+                matchesNothing = true;
+            return true;
+        }
+        // Handle compares, then per-handle cached contains, then strcmp, then substring scans
+        test.cost = interned ? (test.contains ? 1 : 0) : (test.contains ? 3 : 2);
+        textTests.push_back(test);
+        return true;
+    }
+
+    static bool passes(TextTest &test, const Patient &p)
+    {
+        bool hit;
+        if (test.field == FIELD_ADDRESS || test.field == FIELD_DIAGNOSIS)
+        {
+            uint32_t handle = test.field == FIELD_ADDRESS ? p.getAddressId() : p.getDiagnosisId();
+            if (!test.contains)
+                hit = handle == test.handle;
+            else
+            {
+                auto it = test.seen.find(handle);
+                if (it == test.seen.end())
+                    it = test.seen.emplace(handle, containsIgnoreCase(StringPool::getInstance()->get(handle), test.text)).first;
+                hit = it->second;
+            }
+        }
+        else
+        {
+            const char *value = test.field == FIELD_NAME ? p.getName() : p.getContactNumber();
+            hit = test.contains ? containsIgnoreCase(value, test.text) : strcmp(value, test.text.c_str()) == 0;
+        }
+        return hit != test.negate;
+    }
+
+    // keep[i] stays 0xFF only where values[i] passes the test
+    static void narrow(const ColumnTest &test, const int32_t *values, size_t count, uint8_t *keep)
+    {
+        size_t i = 0;
+#ifdef __SSE2__
+        const __m128i operand = _mm_set1_epi32(test.operand);
+        const __m128i less = _mm_set1_epi32(test.acceptLess ? -1 : 0);
+        const __m128i equal = _mm_set1_epi32(test.acceptEqual ? -1 : 0);
+        const __m128i greater = _mm_set1_epi32(test.acceptGreater ? -1 : 0);
+        auto lanes = [&](size_t at)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(values + at));
+            return _mm_or_si128(_mm_or_si128(_mm_and_si128(less, _mm_cmplt_epi32(v, operand)),
+                                             _mm_and_si128(equal, _mm_cmpeq_epi32(v, operand))),
+                                _mm_and_si128(greater, _mm_cmpgt_epi32(v, operand)));
+        };
+        for (; i + 16 <= count; i += 16)
+        {
+            // Saturating packs turn four 32-bit masks into sixteen byte masks
+            __m128i hits = _mm_packs_epi16(_mm_packs_epi32(lanes(i), lanes(i + 4)), _mm_packs_epi32(lanes(i + 8), lanes(i + 12)));
+            __m128i current = _mm_loadu_si128((const __m128i *)(keep + i));
+            _mm_storeu_si128((__m128i *)(keep + i), _mm_and_si128(current, hits));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            bool hit = values[i] < test.operand ? test.acceptLess : values[i] == test.operand ? test.acceptEqual
+                                                                                              : test.acceptGreater;
+            keep[i] &= hit ? 0xFF : 0;
+        }
+    }
+
+public:
+    // Returns false and sets error when the text is not a valid query.
+    // Equality on address or diagnosis is resolved to an interned handle
+    // here, so compile after the registry is loaded and run soon after.
+    bool compile(const string &text, string &error)
+    {
+        columnTests.clear();
+        textTests.clear();
+        matchesNothing = false;
+
+        vector<Token> tokens;
+        if (!tokenize(text, tokens, error))
+            return false;
+        if (tokens.empty())
+        {
+            error = "Empty query";
+            return false;
+        }
+
+        for (size_t i = 0; i < tokens.size(); i += 4)
+        {
+            Field field;
+            Op op;
+            if (tokens[i].quoted || !parseField(tokens[i].text, field))
+            {
+                error = "Unknown field '" + tokens[i].text + "'";
+                return false;
+            }
+            if (i + 2 >= tokens.size() || !parseOp(tokens[i + 1], op))
+            {
+                error = "Expected an operator and a value after '" + tokens[i].text + "'";
+                return false;
+            }
+            if (!addCondition(field, op, tokens[i + 2].text, error))
+                return false;
+            if (i + 3 < tokens.size() && (tokens[i + 3].quoted || lower(tokens[i + 3].text) != "and"))
+            {
+                error = "Expected AND before '" + tokens[i + 3].text + "'; quote values that contain spaces";
+                return false;
+            }
+            if (i + 3 == tokens.size() - 1)
+            {
+                error = "Expected a condition after AND";
+                return false;
+            }
+        }
+
+        stable_sort(textTests.begin(), textTests.end(), [](const TextTest &a, const TextTest &b)
+                    { return a.cost < b.cost; });
+        return true;
+    }
+
+    // Calls visit(patient) for every match, in ID order, batch by batch
+    // over a snapshot. Returns the number of matches.
+    template <typename Visitor>
+    long long run(Visitor visit)
+    {
+        if (matchesNothing)
+            return 0;
+
+        StorageEngine *fh = StorageEngine::getInstance();
+        long long snapshot = fh->beginSnapshot(), matches = 0;
+        vector<Patient> batch;
+        vector<int32_t> column;
+        vector<uint8_t> keep;
+        vector<uint32_t> selected;
+        int fromId = INT_MIN;
+        bool more = true;
+        while (more)
+        {
+            batch.clear();
+            more = fh->readSnapshot(snapshot, fromId, batch);
+            size_t count = batch.size();
+
+            keep.assign(count, 0xFF);
+            column.resize(count);
+            for (const ColumnTest &test : columnTests)
+            {
+                if (test.field == FIELD_ID)
+                    for (size_t i = 0; i < count; i++)
+                        column[i] = batch[i].getId();
+                else if (test.field == FIELD_AGE)
+                    for (size_t i = 0; i < count; i++)
+                        column[i] = batch[i].getAge();
+                else
+                    for (size_t i = 0; i < count; i++)
+                        column[i] = batch[i].getGender();
+                narrow(test, column.data(), count, keep.data());
+            }
+
+            selected.clear();
+            for (size_t i = 0; i < count; i++)
+                if (keep[i])
+                    selected.push_back((uint32_t)i);
+            for (TextTest &test : textTests)
+            {
+                size_t kept = 0;
+                for (uint32_t row : selected)
+                    if (passes(test, batch[row]))
+                        selected[kept++] = row;
+                selected.resize(kept);
+            }
+
+            for (uint32_t row : selected)
+                visit(batch[row]);
+            matches += (long long)selected.size();
+        }
+        fh->endSnapshot(snapshot);
+        return matches;
+    }
+};
+
+class AdminMenuStrategy : public MenuStrategy
+{
+    void manageMenu(const char *role, int count)
+    {
+        StorageEngine *fh = StorageEngine::getInstance();
+        bool *rights = fh->getAccessRights(role, count);
+
+        cout << "\n"
+             << role << " Current Status\n--------------------------------\n";
+        for (int i = 0; i < count; i++)
+            cout << (i == 0 ? "View" : i == 1 ? (role == "Doctor" ? "Update" : "Register")
+                                              : "Delete")
+                 << " - " << (rights[i] ? "ENABLED" : "DISABLED") << endl;
+
+        bool newRights[count], changed = false;
+        copy(rights, rights + count, newRights);
+
+        for (int i = 0; i < count; i++)
+        {
+            string action = (i == 0 ? "view" : i == 1 ? (role == "Doctor" ? "update" : "register") : "delete");
+            
+            // Ask whether to enable or disable based on current state
+            if (rights[i]) {
+                cout << "Disable " << action << "? (Y/N): ";
+            } else {
+                cout << "Enable " << action << "? (Y/N): ";
+            }
+            
+            char c;
+            cin >> c;
+            cin.ignore();
+            
+            if (toupper(c) == 'Y') {
+                // If it's currently enabled, disable it, and vice versa
+                newRights[i] = !rights[i];
+                changed = true;
+            }
+        }
+
+        if (changed)
+        {
+            cout << "Apply changes?(Y/N): ";
+            char c;
+            cin >> c;
+            cin.ignore();
+            if (toupper(c) == 'Y')
+            {
+                fh->updateAccessRights(role, newRights, count);
+                cout << "Changes applied!\n";
+            }
+            else
+                cout << "Changes discarded.\n";
+        }
+        else
+            cout << "No changes applied!\n";
+
+        MemoryAccounting::deleteArray(MEM_RIGHTS, rights, count);
+    }
+
+    void archiveInactive()
+    {
+        cout << "\nArchive patients not viewed or updated for how many days? (0 to cancel): ";
+        string daysStr;
+        getline(cin, daysStr);
+
+        Validated<int> days = InputValidator::parseNumber(daysStr, 0, 36500);
+        if (!days.ok())
+        {
+            cout << "Invalid input!\n";
+            return;
+        }
+        if (!days.value)
+            return;
+
+        int archived = StorageEngine::getInstance()->archiveInactivePatients(days.value);
+        cout << archived << " patient(s) moved to the archive.\n";
+    }
+
+    void viewAccessHistory()
+    {
+        cout << "\nEnter patient ID: ";
+        string idStr;
+        getline(cin, idStr);
+
+        Validated<int> parsed = InputValidator::parseNumber(idStr, 1, INT_MAX);
+        if (!parsed.ok())
+        {
+            cout << "Invalid input!\n";
+            return;
+        }
+
+        int id = parsed.value;
+        vector<AuditEvent> events = AuditTrail::getInstance()->history(id);
+        if (events.empty())
+        {
+            cout << "No recorded access for patient " << id << ".\n";
+            return;
+        }
+
+        cout << "\nAccess history for patient " << id << ":\n";
+        for (const AuditEvent &event : events)
+        {
+            time_t seconds = (time_t)(event.timestamp / 1000000);
+            char when[32];
+            strftime(when, sizeof when, "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+            const char *action = event.action == AUDIT_VIEW       ? "viewed"
+                                 : event.action == AUDIT_REGISTER ? "registered"
+                                 : event.action == AUDIT_UPDATE   ? "updated"
+                                                                  : "deleted";
+            cout << when << " - " << event.actor << " " << action << endl;
+        }
+    }
+
+    void findDuplicates()
+    {
+        Patient *patients;
+        int count;
+        StorageEngine::getInstance()->loadAllPatients(patients, count);
+
+        auto started = chrono::steady_clock::now();
+        vector<pair<int, int>> duplicates = DuplicateDetector::findAll(patients, count);
+        double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+        for (const auto &dup : duplicates)
+            cout << "ID " << patients[dup.first].getId() << " (" << patients[dup.first].getName() << ") <-> ID "
+                 << patients[dup.second].getId() << " (" << patients[dup.second].getName() << ")\n";
+        cout << duplicates.size() << " possible duplicate pair(s) among " << count << " patients, found in "
+             << millis << " ms.\n";
+        MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+    }
+
+    static string promptUsername()
+    {
+        while (true)
+        {
+            cout << "Username: ";
+            string username;
+            getline(cin, username);
+            if (InputValidator::checkUsername(username) == InputError::None)
+                return username;
+            cout << "Invalid input! Use up to 18 letters, digits, '.', '_' or '-'.\n";
+        }
+    }
+
+    static string promptPassword()
+    {
+        while (true)
+        {
+            cout << "Password: ";
+            string password;
+            getline(cin, password);
+            if (password.size() >= 6)
+                return password;
+            cout << "Invalid input! Use at least 6 characters.\n";
+        }
+    }
+
+    void editPermissions(StaffDirectory *staff, const string &username)
+    {
+        uint32_t permissions;
+        if (!staff->getPermissions(username, permissions))
+        {
+            cout << "No such account.\n";
+            return;
+        }
+
+        uint32_t updated = permissions;
+        for (int i = 0; i < permissionCount; i++)
+        {
+            bool enabled = permissions & (1u << i);
+            cout << permissionNames[i] << " - " << (enabled ? "ENABLED" : "DISABLED") << ". "
+                 << (enabled ? "Disable" : "Enable") << "? (Y/N): ";
+            char c;
+            cin >> c;
+            cin.ignore();
+            if (toupper(c) == 'Y')
+                updated ^= 1u << i;
+        }
+
+        if (updated == permissions)
+            cout << "No changes applied!\n";
+        else if (staff->setPermissions(username, updated))
+            cout << "Changes applied!\n";
+        else
+            cout << "Refused: at least one Admin account must keep staff management.\n";
+    }
+
+    void manageStaff()
+    {
+        if (!StaffDirectory::allows(PERM_MANAGE_STAFF))
+            throw PermissionDeniedException();
+
+        StaffDirectory *staff = StaffDirectory::getInstance();
+        cout << "\n1. List accounts\n2. Add account\n3. Remove account\n4. Reset password\n5. Edit permissions\n6. Back\nEnter your choice: ";
+        string choiceStr;
+        getline(cin, choiceStr);
+        Validated<int> choice = InputValidator::parseNumber(choiceStr, 1, 6);
+        if (!choice.ok())
+        {
+            cout << "Invalid input!\n";
+            return;
+        }
+
+        if (choice.value == 1)
+        {
+            vector<pair<string, string>> accounts = staff->list();
+            for (const auto &account : accounts)
+                cout << account.first << " (" << account.second << ")\n";
+            cout << accounts.size() << " account(s).\n";
+        }
+        else if (choice.value == 2)
+        {
+            string username = promptUsername(), role;
+            while (true)
+            {
+                cout << "Role (Admin/Doctor/Receptionist): ";
+                getline(cin, role);
+                if (StaffDirectory::isRole(role))
+                    break;
+                cout << "Invalid input!\n";
+            }
+            string password = promptPassword();
+            if (staff->addAccount(username, role, password))
+                cout << "Account " << username << " created.\n";
+            else
+                cout << "Username already taken.\n";
+        }
+        else if (choice.value == 3)
+        {
+            string username = promptUsername();
+            if (staff->removeAccount(username))
+                cout << "Account removed.\n";
+            else
+                cout << "No such account, or it is the last Admin that can manage staff.\n";
+        }
+        else if (choice.value == 4)
+        {
+            string username = promptUsername();
+            string password = promptPassword();
+            cout << (staff->setPassword(username, password) ? "Password changed.\n" : "No such account.\n");
+        }
+        else if (choice.value == 5)
+            editPermissions(staff, promptUsername());
+    }
+
+public:
+    void displayMenu() override
+    {
+        cout << "\n---Admin---\n1. Manage doctor's menu\n2. Manage receptionist's menu\n3. Archive inactive patients\n4. View patient access history\n5. Find duplicate patients\n6. Manage staff accounts\n7. Memory report\n8. Back\nEnter your choice: ";
+    }
+
+    void handleChoice(int choice) override
+    {
+        if (choice == 1)
+            manageMenu("Doctor", 3);
+        else if (choice == 2)
+            manageMenu("Receptionist", 2);
+        else if (choice == 3)
+            archiveInactive();
+        else if (choice == 4)
+            viewAccessHistory();
+        else if (choice == 5)
+            findDuplicates();
+        else if (choice == 6)
+            manageStaff();
+        else if (choice == 7)
+        {
+            if (MemoryAccounting::isEnabled())
+                MemoryAccounting::report();
+            else
+                cout << "Memory accounting is off; start the program with --track-memory.\n";
+        }
+    }
+};
+
+class DoctorMenuStrategy : public MenuStrategy
+{
+    void viewPatientRecords()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+                throw PermissionDeniedException();
+
+            Patient *patients;
+            int count;
+            fh->loadAllPatients(patients, count);
+
+            if (!count)
+            {
+                MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                cout << "No patients registered yet.\n";
+                return;
+            }
+
+            cout << "\nPatient List:\n";
+            for (int i = 0; i < count; i++)
+                patients[i].displayShort();
+
+            cout << "\nEnter patient ID to view details (0 to cancel): ";
+            int id;
+            cin >> id;
+            cin.ignore();
+            if (!id)
+            {
+                MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                return;
+            }
+
+            for (int i = 0; i < count; i++)
+            {
+                if (patients[i].getId() == id)
+                {
+                    cout << "\nPatient Details:\n";
+                    patients[i].display();
+                    fh->touchPatient(id);
+                    AuditTrail::getInstance()->record(AUDIT_VIEW, id);
+                    MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                    return;
+                }
+            }
+            MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+
+            // Not in the active list: may have been archived
+            Patient archived = fh->getPatient(id);
+            cout << "\nPatient Details (archived):\n";
+            archived.display();
+            AuditTrail::getInstance()->record(AUDIT_VIEW, id);
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+        catch (PatientNotFoundException &e)
+        {
+            cout << "Patient not found.\n";
+        }
+    }
+
+    void updatePatientRecord()
+    {
+    try
+    {
+        // Check permission
+        StorageEngine *fh = StorageEngine::getInstance();
+        if (!StaffDirectory::allows(PERM_UPDATE_PATIENTS))
+            throw PermissionDeniedException();
+
+        Patient *patients;
+        int count;
         fh->loadAllPatients(patients, count);
 
-        if (!count)
+        if (!count)
+        {
+            MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+            cout << "No patients registered yet.\n";
+            return;
+        }
+
+        cout << "\nPatient List:\n";
+        for (int i = 0; i < count; i++)
+            patients[i].displayShort();
+
+        int id = 0;
+        bool validPatient = false;
+        
+        while (!validPatient)
+        {
+            cout << "\nEnter patient ID to update (0 to cancel): ";
+            cin >> id;
+            cin.ignore();
+            
+            if (id == 0)
+            {
+                MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                return;
+            }
+
+            bool found = false;
+            for (int i = 0; i < count; i++)
+            {
+                if (patients[i].getId() == id)
+                {
+                    cout << "\nCurrent Diagnosis: " << patients[i].getDiagnosis() << "\nEnter new diagnosis: ";
+                    string diag;
+                    getline(cin, diag);
+                    patients[i].setDiagnosis(diag.c_str());
+                    try
+                    {
+                        fh->updatePatient(patients[i]);
+                        cout << "Diagnosis updated!\n";
+                    }
+                    catch (VersionConflictException &e)
+                    {
+                        // Someone else saved first; nothing was overwritten
+                        cout << e.what() << ". Your change was not saved; reopen the record and try again.\n";
+                    }
+                    found = true;
+                    validPatient = true;
+                    break;
+                }
+            }
+
+            if (!found)
+            {
+                cout << "Patient not found. Please try again.\n";
+            }
+        }
+        
+        MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+    }
+        catch (PermissionDeniedException &e)
+        {
+        cout << e.what() << endl;
+        }
+    }
+
+    void deletePatientRecord()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_DELETE_PATIENTS))
+                throw PermissionDeniedException();
+
+            Patient *patients;
+            int count;
+            fh->loadAllPatients(patients, count);
+
+            if (!count)
+            {
+                MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                cout << "No patients registered yet.\n";
+                return;
+            }
+
+            cout << "\nPatient List:\n";
+            for (int i = 0; i < count; i++)
+                patients[i].displayShort();
+
+            int id = 0;
+            bool validPatient = false;
+            
+            while (!validPatient)
+            {
+                cout << "\nEnter patient ID to delete (0 to cancel): ";
+                cin >> id;
+                cin.ignore();
+                
+                if (id == 0)
+                {
+                    MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                    return;
+                }
+
+                bool found = false;
+                for (int i = 0; i < count; i++)
+                {
+                    if (patients[i].getId() == id)
+                    {
+                        found = true;
+                        cout << "Confirm deletion?(Y/N): ";
+                        char c;
+                        cin >> c;
+                        cin.ignore();
+                        if (toupper(c) == 'Y')
+                        {
+                            removePatient(id);
+                            cout << "Patient deleted!\n";
+                        }
+                        else
+                            cout << "Deletion cancelled.\n";
+                        
+                        validPatient = true;
+                        break;
+                    }
+                }
+
+                if (!found)
+                {
+                    cout << "Patient not found. Please try again.\n";
+                }
+            }
+            
+            MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+    }
+
+    void bulkUpdateDiagnoses()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_UPDATE_PATIENTS))
+                throw PermissionDeniedException();
+
+            StorageEngine::Transaction t = fh->beginTransaction();
+            while (true)
+            {
+                int id = promptPatientId("correct", "finish");
+                if (!id)
+                    break;
+
+                try
+                {
+                    Patient p = fh->getPatient(id);
+                    cout << "Current Diagnosis: " << p.getDiagnosis() << "\nEnter new diagnosis: ";
+                    string diag;
+                    getline(cin, diag);
+                    p.setDiagnosis(diag.c_str());
+                    t.updatePatient(p);
+                }
+                catch (PatientNotFoundException &e)
+                {
+                    cout << "Patient not found. Please try again.\n";
+                }
+            }
+
+            if (!t.size())
+                return;
+            cout << "Commit " << t.size() << " change(s)?(Y/N): ";
+            string answer;
+            getline(cin, answer);
+            if (answer.empty() || toupper(answer[0]) != 'Y')
+            {
+                t.rollback();
+                cout << "Changes discarded.\n";
+                return;
+            }
+
+            int changes = t.size();
+            fh->commit(t);
+            cout << changes << " diagnosis update(s) committed.\n";
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+        catch (PatientNotFoundException &e)
+        {
+            cout << "Transaction rolled back: " << e.what() << endl;
+        }
+        catch (VersionConflictException &e)
+        {
+            cout << "Transaction rolled back: " << e.what() << endl;
+        }
+        catch (FileOperationException &e)
+        {
+            cout << "Transaction rolled back: " << e.what() << endl;
+        }
+    }
+
+    void findPatientsByDiagnosis()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+                throw PermissionDeniedException();
+
+            cout << "Enter diagnosis: ";
+            string diag;
+            getline(cin, diag);
+
+            Patient *patients;
+            int count;
+            fh->findByDiagnosis(diag.c_str(), patients, count);
+            for (int i = 0; i < count; i++)
+                patients[i].displayShort();
+            cout << count << " patient(s) with this diagnosis.\n";
+            MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+    }
+
+    void searchPatients()
+    {
+        try
+        {
+            // Check permission
+            if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+                throw PermissionDeniedException();
+
+            cout << "Filter (e.g. age > 65 AND gender = F AND diagnosis contains diabetes): ";
+            string text, error;
+            getline(cin, text);
+
+            PatientQuery query;
+            if (!query.compile(text, error))
+            {
+                cout << "Invalid filter: " << error << "\n";
+                return;
+            }
+            auto started = chrono::steady_clock::now();
+            long long matches = query.run([](const Patient &p)
+                                          { p.displayShort(); });
+            cout << matches << " patient(s) matched in "
+                 << chrono::duration<double, milli>(chrono::steady_clock::now() - started).count() << " ms.\n";
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+    }
+
+    void prescribeMedication()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_UPDATE_PATIENTS))
+                throw PermissionDeniedException();
+
+            int id = promptPatientId("prescribe for");
+            if (!id)
+                return;
+            Patient patient = fh->getPatient(id);
+
+            Prescription *history;
+            int count;
+            fh->loadPrescriptions(id, history, count);
+            vector<Prescription> active;
+            time_t now = time(nullptr);
+            for (int i = 0; i < count; i++)
+                if (history[i].isActive(now))
+                    active.push_back(history[i]);
+            delete[] history;
+
+            cout << "Active medications for " << patient.getName() << ":";
+            for (const Prescription &p : active)
+                cout << "\n  " << p.drug << " (" << p.dosage << ")";
+            cout << (active.empty() ? " none\n" : "\n");
+
+            string drug, dosage;
+            int days;
+            while (true)
+            {
+                cout << "Drug (generic name): ";
+                getline(cin, drug);
+                if (InputValidator::checkName(drug) == InputError::None)
+                    break;
+                cout << "Invalid input!\n";
+            }
+            transform(drug.begin(), drug.end(), drug.begin(), ::tolower);
+
+            while (true)
+            {
+                cout << "Dosage: ";
+                getline(cin, dosage);
+                if (InputValidator::checkAddress(dosage) == InputError::None)
+                    break;
+                cout << "Invalid input!\n";
+            }
+
+            while (true)
+            {
+                cout << "Duration in days: ";
+                string daysStr;
+                getline(cin, daysStr);
+                Validated<int> parsed = InputValidator::parseNumber(daysStr, 1, 365);
+                if (parsed.ok())
+                {
+                    days = parsed.value;
+                    break;
+                }
+                cout << "Invalid input!\n";
+            }
+
+            bool major = false;
+            for (const Prescription &p : active)
+            {
+                const DrugInteraction *hit = DrugInteractionTable::find(drug.c_str(), p.drug.c_str());
+                if (!hit)
+                    continue;
+                const char *severity = hit->severity == INTERACTION_MAJOR      ? "MAJOR"
+                                       : hit->severity == INTERACTION_MODERATE ? "moderate"
+                                                                               : "minor";
+                cout << "Interaction (" << severity << "): " << drug << " + " << p.drug << " - " << hit->effect << "\n";
+                major = major || hit->severity == INTERACTION_MAJOR;
+            }
+            if (major)
+            {
+                cout << "Prescribe despite the major interaction?(Y/N): ";
+                string answer;
+                getline(cin, answer);
+                if (answer.empty() || toupper(answer[0]) != 'Y')
+                {
+                    cout << "Prescription cancelled.\n";
+                    return;
+                }
+            }
+
+            Prescription p{0, id, drug, dosage, now, now + (time_t)days * 24 * 60 * 60};
+            fh->savePrescription(p);
+            cout << "Prescription " << p.id << " recorded.\n";
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+        catch (PatientNotFoundException &e)
+        {
+            cout << e.what() << endl;
+        }
+    }
+
+    void vitals()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+                throw PermissionDeniedException();
+
+            int id = promptPatientId("see vitals for");
+            if (!id)
+                return;
+            Patient patient = fh->getPatient(id);
+
+            cout << "1. Record a reading\n2. Summary of recent readings\nEnter your choice: ";
+            string choice;
+            getline(cin, choice);
+            VitalsStore *store = VitalsStore::getInstance();
+            int64_t now = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+
+            if (choice == "1")
+            {
+                for (int m = 0; m < VITAL_METRIC_COUNT; m++)
+                    cout << m + 1 << ". " << vitalMetrics[m].name << " (" << vitalMetrics[m].unit << ")\n";
+                int metric;
+                while (true)
+                {
+                    cout << "Metric: ";
+                    string metricStr;
+                    getline(cin, metricStr);
+                    Validated<int> parsed = InputValidator::parseNumber(metricStr, 1, VITAL_METRIC_COUNT);
+                    if (parsed.ok())
+                    {
+                        metric = parsed.value - 1;
+                        break;
+                    }
+                    cout << "Invalid input!\n";
+                }
+
+                const VitalMetricInfo &info = vitalMetrics[metric];
+                while (true)
+                {
+                    cout << info.name << " (" << info.unit << "): ";
+                    string valueStr;
+                    getline(cin, valueStr);
+                    char *end;
+                    double value = strtod(valueStr.c_str(), &end);
+                    if (end != valueStr.c_str() && *end == '\0' &&
+                        store->record(id, (VitalMetric)metric, now, (int)lround(value * info.scale)))
+                        break;
+                    cout << "Invalid input!\n";
+                }
+                cout << "Reading recorded for " << patient.getName() << ".\n";
+            }
+            else if (choice == "2")
+            {
+                int hours;
+                while (true)
+                {
+                    cout << "Hours to look back: ";
+                    string hoursStr;
+                    getline(cin, hoursStr);
+                    Validated<int> parsed = InputValidator::parseNumber(hoursStr, 1, 24 * 365);
+                    if (parsed.ok())
+                    {
+                        hours = parsed.value;
+                        break;
+                    }
+                    cout << "Invalid input!\n";
+                }
+
+                cout << "Vitals for " << patient.getName() << " over the last " << hours << " hour(s):\n";
+                for (int m = 0; m < VITAL_METRIC_COUNT; m++)
+                {
+                    const VitalMetricInfo &info = vitalMetrics[m];
+                    VitalsSummary summary = store->query(id, (VitalMetric)m, now - (int64_t)hours * 3600 * 1000, now);
+                    cout << "  " << info.name << ": ";
+                    if (!summary.count)
+                    {
+                        cout << "no readings\n";
+                        continue;
+                    }
+                    cout << "min " << (double)summary.minValue / info.scale << ", max "
+                         << (double)summary.maxValue / info.scale << ", avg "
+                         << (double)summary.sum / summary.count / info.scale << " " << info.unit << " ("
+                         << summary.count << " reading(s))\n";
+                }
+            }
+            else
+                cout << "Invalid choice!\n";
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+        catch (PatientNotFoundException &e)
+        {
+            cout << e.what() << endl;
+        }
+    }
+
+    void callNextPatient()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+                throw PermissionDeniedException();
+
+            TriageQueue *queue = TriageQueue::getInstance();
+            TriageEntry next;
+            while (queue->dequeue(next))
+            {
+                try
+                {
+                    Patient p = fh->getPatient(next.patientId);
+                    cout << "\nNext patient (priority " << next.priority << "):\n";
+                    p.display();
+                    AuditTrail::getInstance()->record(AUDIT_VIEW, p.getId());
+                    cout << queue->size() << " patient(s) still waiting.\n";
+                    return;
+                }
+                catch (PatientNotFoundException &e)
+                {
+                    // Record was deleted while waiting; skip to the next one
+                }
+            }
+
+            cout << "No patients waiting.\n";
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+    }
+
+public:
+    // Prompt-free operations, shared by the menu and scripted sessions
+    Patient viewPatient(int id)
+    {
+        StorageEngine *fh = StorageEngine::getInstance();
+        if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+            throw PermissionDeniedException();
+
+        Patient p = fh->getPatient(id);
+        fh->touchPatient(id);
+        AuditTrail::getInstance()->record(AUDIT_VIEW, id);
+        return p;
+    }
+
+    void updateDiagnosis(int id, const string &diagnosis)
+    {
+        StorageEngine *fh = StorageEngine::getInstance();
+        if (!StaffDirectory::allows(PERM_UPDATE_PATIENTS))
+            throw PermissionDeniedException();
+
+        Patient p = fh->getPatient(id);
+        p.setDiagnosis(diagnosis.c_str());
+        fh->updatePatient(p);
+    }
+
+    void removePatient(int id)
+    {
+        StorageEngine *fh = StorageEngine::getInstance();
+        if (!StaffDirectory::allows(PERM_DELETE_PATIENTS))
+            throw PermissionDeniedException();
+
+        fh->deletePatient(id);
+        TriageQueue::getInstance()->remove(id);
+        BedBoard::getInstance()->discharge(id);
+    }
+
+    void displayMenu() override
+    {
+        cout << "\n---Doctor Menu---\n";
+        cout << "1. View records\n";
+        cout << "2. Update record\n";
+        cout << "3. Delete record\n";
+        cout << "4. Call next patient\n";
+        cout << "5. Bulk update diagnoses\n";
+        cout << "6. Find patients by diagnosis\n";
+        cout << "7. Prescribe medication\n";
+        cout << "8. Vitals\n";
+        cout << "9. Search patients\n";
+        cout << "10. Back\nEnter your choice: ";
+    }
+
+    void handleChoice(int choice) override
+    {
+        switch (choice)
+        {
+        case 1:
+            viewPatientRecords();
+            break;
+        case 2:
+            updatePatientRecord();
+            break;
+        case 3:
+            deletePatientRecord();
+            break;
+        case 4:
+            callNextPatient();
+            break;
+        case 5:
+            bulkUpdateDiagnoses();
+            break;
+        case 6:
+            findPatientsByDiagnosis();
+            break;
+        case 7:
+            prescribeMedication();
+            break;
+        case 8:
+            vitals();
+            break;
+        case 9:
+            searchPatients();
+            break;
+        }
+    }
+};
+
+class ReceptionistMenuStrategy : public MenuStrategy
+{
+    void viewRecords()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+                throw PermissionDeniedException();
+
+            Patient *patients;
+            int count;
+            fh->loadAllPatients(patients, count);
+
+            if (!count)
+            {
+                MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                cout << "No patients registered yet.\n";
+                return;
+            }
+
+            cout << "\nPatient List:\n";
+            for (int i = 0; i < count; i++)
+                patients[i].displayShort();
+
+            int id = 0;
+            bool validInput = false;
+            while (!validInput)
+            {
+                cout << "\nEnter patient ID to view (0 to cancel): ";
+                string idStr;
+                getline(cin, idStr);
+
+                Validated<int> parsed = InputValidator::parseNumber(idStr, 0, INT_MAX);
+                if (parsed.error == InputError::TooLarge)
+                    cout << "ID value is too large! Please enter a smaller number.";
+                else if (!parsed.ok())
+                    cout << "Invalid input!";
+                else
+                {
+                    id = parsed.value;
+                    validInput = true;
+                }
+            }
+
+            if (id == 0)
+            {
+                MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+                return;
+            }
+
+            MemoryAccounting::deleteArray(MEM_PATIENT_LISTS, patients, count);
+
+            // getPatient also finds archived patients
+            try
+            {
+                Patient p = fh->getPatient(id);
+                cout << "\nPatient Details:\nID: " << id << "\nName: " << p.getName()
+                     << "\nAge: " << p.getAge() << "\nGender: " << p.getGender()
+                     << "\nAddress: " << p.getAddress() << "\nContact: " << p.getContactNumber() << endl;
+                fh->touchPatient(id);
+                AuditTrail::getInstance()->record(AUDIT_VIEW, id);
+            }
+            catch (PatientNotFoundException &e)
+            {
+                cout << "Patient not found with ID: " << id << "\n";
+            }
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+        catch (HospitalException &e)
+        {
+            cout << "Hospital system error: " << e.what() << endl;
+        }
+        catch (std::exception &e)
+        {
+            cout << "Unexpected error: " << e.what() << endl;
+        }
+    }
+
+    bool isValidReceptionistMenuInput(const string &input)
+    {
+        return InputValidator::parseNumber(input, 1, 3).ok();
+    }
+
+    void execute()
+    {
+        while (true)
         {
-            cout << "No patients registered yet.\n";
-            return;
-        }
+            cout << "\n------- Receptionist Menu --------\n";
+            cout << "1. View Records\n";
+            cout << "2. Register Patient\n";
+            cout << "3. Back\n";
+            cout << "Enter your choice: ";
 
-        cout << "\nPatient List:\n";
-        for (int i = 0; i < count; i++)
-            patients[i].displayShort();
+            string input;
+            getline(cin, input);
 
-        int id = 0;
-        bool validPatient = false;
-        
-        while (!validPatient)
-        {
-            cout << "\nEnter patient ID to update (0 to cancel): ";
-            cin >> id;
-            cin.ignore();
-            
-            if (id == 0)
+            if (!isValidReceptionistMenuInput(input))
+            {
+                cout << "Invalid input! Please enter only numbers between 1-3.\n";
+                continue;
+            }
+
+            int choice = stoi(input);
+
+            switch (choice)
             {
-                delete[] patients;
+            case 1:
+                viewRecords();
+                break;
+            case 2:
+                registerPatient();
+                break;
+            case 3:
                 return;
+            default:
+                // This should never execute due to validation
+                cout << "Invalid choice. Please try again.\n";
             }
+        }
+    }
 
-            bool found = false;
-            for (int i = 0; i < count; i++)
+    void registerPatient()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_REGISTER_PATIENTS))
+                throw PermissionDeniedException();
+
+            int id = fh->getNextPatientId();
+
+            cout << "\nPatient Registration\n--------------------------\n";
+            Patient p(id);
+            PatientSchema::prompt(p);
+
+            vector<int> matches = fh->findDuplicates(p);
+            if (!matches.empty())
             {
-                if (patients[i].getId() == id)
+                cout << "\nPossible duplicate of:\n";
+                for (int match : matches)
+                    fh->getPatient(match).displayShort();
+                cout << "Register anyway?(Y/N): ";
+                string answer;
+                getline(cin, answer);
+                if (answer.empty() || toupper(answer[0]) != 'Y')
                 {
-                    cout << "\nCurrent Diagnosis: " << patients[i].getDiagnosis() << "\nEnter new diagnosis: ";
-                    string diag;
-                    getline(cin, diag);
-                    patients[i].setDiagnosis(diag.c_str());
-                    fh->updatePatient(patients[i]);
-                    cout << "Diagnosis updated!\n";
-                    found = true;
-                    validPatient = true;
-                    break;
+                    cout << "Registration cancelled.\n";
+                    return;
                 }
             }
 
-            if (!found)
-            {
-                cout << "Patient not found. Please try again.\n";
-            }
+            fh->savePatient(p);
+            cout << "Patient registered with ID: " << id << endl;
         }
-        
-        delete[] patients;
-    }
         catch (PermissionDeniedException &e)
         {
-        cout << e.what() << endl;
+            cout << e.what() << endl;
         }
     }
 
-    void deletePatientRecord()
+    void addToQueue()
     {
         try
         {
             // Check permission
-            FileHandler *fh = FileHandler::getInstance();
-            int count;
-            bool *rights = fh->getAccessRights("Doctor", count);
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_REGISTER_PATIENTS))
+                throw PermissionDeniedException();
 
-            if (!rights[2])
+            int id = 0, priority = 0;
+            while (true)
             {
-                delete[] rights;
-                throw PermissionDeniedException();
-            }
-            delete[] rights;
+                cout << "\nEnter patient ID to queue (0 to cancel): ";
+                string idStr;
+                getline(cin, idStr);
 
-            Patient *patients;
-            fh->loadAllPatients(patients, count);
+                Validated<int> parsed = InputValidator::parseNumber(idStr, 0, INT_MAX);
+                if (parsed.ok())
+                {
+                    id = parsed.value;
+                    break;
+                }
+                if (parsed.error == InputError::TooLarge)
+                    cout << "ID value is too large! Please enter a smaller number.";
+                else
+                    cout << "Invalid input!";
+            }
 
-            if (!count)
-            {
-                cout << "No patients registered yet.\n";
+            if (id == 0)
                 return;
-            }
 
-            cout << "\nPatient List:\n";
-            for (int i = 0; i < count; i++)
-                patients[i].displayShort();
+            Patient p = fh->getPatient(id);
 
-            int id = 0;
-            bool validPatient = false;
-            
-            while (!validPatient)
+            while (true)
             {
-                cout << "\nEnter patient ID to delete (0 to cancel): ";
-                cin >> id;
-                cin.ignore();
-                
-                if (id == 0)
-                {
-                    delete[] patients;
-                    return;
-                }
+                cout << "Priority (1 = routine ... 5 = critical): ";
+                string priorityStr;
+                getline(cin, priorityStr);
 
-                bool found = false;
-                for (int i = 0; i < count; i++)
+                Validated<int> parsed = InputValidator::parseNumber(priorityStr, 1, 5);
+                if (parsed.ok())
                 {
-                    if (patients[i].getId() == id)
-                    {
-                        found = true;
-                        cout << "Confirm deletion?(Y/N): ";
-                        char c;
-                        cin >> c;
-                        cin.ignore();
-                        if (toupper(c) == 'Y')
-                        {
-                            fh->deletePatient(id);
-                            cout << "Patient deleted!\n";
-                        }
-                        else
-                            cout << "Deletion cancelled.\n";
-                        
-                        validPatient = true;
-                        break;
-                    }
+                    priority = parsed.value;
+                    break;
                 }
+                cout << "Invalid input!\n";
+            }
 
-                if (!found)
-                {
-                    cout << "Patient not found. Please try again.\n";
-                }
+            TriageQueue *queue = TriageQueue::getInstance();
+            queue->enqueue(id, priority);
+            cout << p.getName() << " is waiting with priority " << priority << " (" << queue->size() << " in queue).\n";
+        }
+        catch (PermissionDeniedException &e)
+        {
+            cout << e.what() << endl;
+        }
+        catch (PatientNotFoundException &e)
+        {
+            cout << e.what() << endl;
+        }
+    }
+
+    // 0 picks any; returns the index of the chosen name, or -1 for any
+    static int promptOption(const char *title, const vector<string> &names)
+    {
+        cout << "0. Any " << title << "\n";
+        for (size_t i = 0; i < names.size(); i++)
+            cout << i + 1 << ". " << names[i] << "\n";
+        while (true)
+        {
+            cout << "Choose a " << title << ": ";
+            string choiceStr;
+            getline(cin, choiceStr);
+            Validated<int> parsed = InputValidator::parseNumber(choiceStr, 0, (int)names.size());
+            if (parsed.ok())
+                return parsed.value - 1;
+            cout << "Invalid input!\n";
+        }
+    }
+
+    void manageBeds()
+    {
+        try
+        {
+            // Check permission
+            StorageEngine *fh = StorageEngine::getInstance();
+            if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+                throw PermissionDeniedException();
+
+            BedBoard *board = BedBoard::getInstance();
+            cout << "\nWard                Type          Free / Beds\n";
+            for (const BedBoard::Occupancy &row : board->occupancy())
+                cout << left << setw(20) << board->getWardName(row.ward) << setw(12) << bedTypeNames[row.type]
+                     << right << setw(6) << row.free << " / " << row.beds << "\n";
+
+            cout << "\n1. Admit patient\n2. Discharge patient\n3. Find a patient's bed\n4. Back\nEnter your choice: ";
+            string choice;
+            getline(cin, choice);
+            if (choice == "4")
+                return;
+            if (choice != "1" && choice != "2" && choice != "3")
+            {
+                cout << "Invalid choice!\n";
+                return;
             }
-            
-            delete[] patients;
+            if (choice != "3" && !StaffDirectory::allows(PERM_REGISTER_PATIENTS))
+                throw PermissionDeniedException();
+
+            int id = promptPatientId(choice == "1" ? "admit" : choice == "2" ? "discharge" : "find");
+            if (id == 0)
+                return;
+            Patient p = fh->getPatient(id);
+            int bed = board->findPatient(id);
+
+            if (choice == "1" && bed >= 0)
+                cout << p.getName() << " is already in " << board->label(bed) << ".\n";
+            else if (choice == "1")
+            {
+                vector<string> wardNames, typeNames(bedTypeNames, bedTypeNames + BED_TYPE_COUNT);
+                for (int w = 0; w < board->getWardCount(); w++)
+                    wardNames.push_back(board->getWardName(w));
+                int ward = promptOption("ward", wardNames), type = promptOption("bed type", typeNames);
+
+                string error;
+                bed = board->admit(id, ward, type, error);
+                if (bed < 0)
+                    cout << error << ".\n";
+                else
+                    cout << p.getName() << " admitted to " << board->label(bed) << " (" << bedTypeNames[board->getType(bed)] << ").\n";
+            }
+            else if (bed < 0)
+                cout << p.getName() << " is not admitted.\n";
+            else if (choice == "2")
+            {
+                board->discharge(id);
+                cout << p.getName() << " discharged from " << board->label(bed) << ".\n";
+            }
+            else
+                cout << p.getName() << " is in " << board->label(bed) << " (" << bedTypeNames[board->getType(bed)] << ").\n";
         }
         catch (PermissionDeniedException &e)
         {
             cout << e.what() << endl;
         }
+        catch (PatientNotFoundException &e)
+        {
+            cout << e.what() << endl;
+        }
     }
 
 public:
+    // Prompt-free operations, shared by scripted sessions
+    Patient viewPatient(int id)
+    {
+        StorageEngine *fh = StorageEngine::getInstance();
+        if (!StaffDirectory::allows(PERM_VIEW_PATIENTS))
+            throw PermissionDeniedException();
+
+        Patient p = fh->getPatient(id);
+        fh->touchPatient(id);
+        AuditTrail::getInstance()->record(AUDIT_VIEW, id);
+        return p;
+    }
+
+    // Returns the new patient ID, or the first validation error; fields
+    // holds the registration fields in PatientSchema order
+    Validated<int> registerPatient(const vector<string> &fields)
+    {
+        StorageEngine *fh = StorageEngine::getInstance();
+        if (!StaffDirectory::allows(PERM_REGISTER_PATIENTS))
+            throw PermissionDeniedException();
+
+        Patient p;
+        InputError error = PatientSchema::fill(p, fields);
+        if (error != InputError::None)
+            return {0, error};
+
+        int id = fh->getNextPatientId();
+        p.setId(id);
+        fh->savePatient(p);
+        return {id, InputError::None};
+    }
+
     void displayMenu() override
     {
-        cout << "\n---Doctor Menu---\n";
+        cout << "\n---Receptionist Menu---\n";
         cout << "1. View records\n";
-        cout << "2. Update record\n";
-        cout << "3. Delete record\n";
-        cout << "4. Back\nEnter your choice: ";
+        cout << "2. Register patient\n";
+        cout << "3. Add patient to waiting queue\n";
+        cout << "4. Beds\n";
+        cout << "5. Back\nEnter your choice: ";
     }
 
     void handleChoice(int choice) override
@@ -723,574 +7517,1320 @@ public:
         switch (choice)
         {
         case 1:
-            viewPatientRecords();
+            viewRecords();
             break;
         case 2:
-            updatePatientRecord();
+            registerPatient();
             break;
         case 3:
-            deletePatientRecord();
+            addToQueue();
+            break;
+        case 4:
+            manageBeds();
             break;
         }
     }
 };
 
-class ReceptionistMenuStrategy : public MenuStrategy
+class Admin : public User
 {
-    void viewRecords()
+public:
+    Admin(const char *username, uint32_t permissions) : User(username, permissions) {}
+    MenuStrategy *createMenuStrategy() override { return new AdminMenuStrategy(); }
+};
+
+class Doctor : public User
+{
+public:
+    Doctor(const char *username, uint32_t permissions) : User(username, permissions) {}
+    MenuStrategy *createMenuStrategy() override { return new DoctorMenuStrategy(); }
+};
+
+class Receptionist : public User
+{
+public:
+    Receptionist(const char *username, uint32_t permissions) : User(username, permissions) {}
+    MenuStrategy *createMenuStrategy() override { return new ReceptionistMenuStrategy(); }
+};
+
+User *User::create(const string &role, const char *username, uint32_t permissions)
+{
+    if (role == "Admin")
+        return new Admin(username, permissions);
+    if (role == "Doctor")
+        return new Doctor(username, permissions);
+    return new Receptionist(username, permissions);
+}
+
+class Hospital
+{
+    User *currentUser = nullptr;
+    MenuStrategy *currentMenu = nullptr;
+
+    int getChoice(int min, int max)
     {
-        try
+        string choiceStr;
+
+        while (true)
         {
-            // Check permission
-            FileHandler *fh = FileHandler::getInstance();
-            int count;
-            bool *rights = fh->getAccessRights("Receptionist", count);
+            getline(cin, choiceStr);
 
-            if (!rights[1])
-            {
-                delete[] rights;
-                throw PermissionDeniedException();
-            }
-            delete[] rights;
+            Validated<int> choice = InputValidator::parseNumber(choiceStr, min, max);
+            if (choice.ok())
+                return choice.value;
 
-            Patient *patients;
-            fh->loadAllPatients(patients, count);
+            if (choice.error == InputError::TooLarge)
+                cout << "Number too large! Enter a number between " << min << " and " << max << ": ";
+            else
+                cout << "Invalid input. Enter a number between " << min << " and " << max << ": ";
+        }
+    }
+
+    void login()
+    {
+        string username, password;
+        cout << "Username: ";
+        getline(cin, username);
+        cout << "Enter password: ";
+        getline(cin, password);
+
+        string role;
+        uint32_t permissions = StaffDirectory::getInstance()->authenticate(username, password, role);
+        currentUser = User::create(role, username.c_str(), permissions);
+        cout << "Login successful!\n";
+        AuditTrail::setActor(currentUser->getUsername());
+        StaffDirectory::setSessionPermissions(permissions);
+        currentMenu = currentUser->createMenuStrategy();
+    }
+
+public:
+    ~Hospital()
+    {
+        delete currentUser;
+        delete currentMenu;
+        // Make sure every queued patient write and audit event reaches disk before exit
+        AuditTrail::getInstance()->shutdown();
+        StorageEngine::getInstance()->shutdown();
+        VitalsStore::getInstance()->shutdown();
+    }
+
+    void start()
+    {
+        StorageEngine *fh = StorageEngine::getInstance();
+        AuditTrail::getInstance();
+        cout << "Loaded " << fh->getPatientCount() << " patient record(s) from "
+             << fh->getLoadSource() << " in " << fh->getStartupMillis() << " ms\n";
+        if (fh->getCorruptRecordCount())
+            cout << "Warning: skipped " << fh->getCorruptRecordCount()
+                 << " damaged record(s) in patients.txt; run with --fsck --repair to quarantine them\n";
 
-            if (!count)
-            {
-                cout << "No patients registered yet.\n";
-                return;
-            }
+        bool running = true;
+        while (running)
+        {
+            string writeError = fh->takeWriteError();
+            if (!writeError.empty())
+                cout << "Error saving patient records: " << writeError << "; the change was undone\n";
 
-            cout << "\nPatient List:\n";
-            for (int i = 0; i < count; i++)
-                patients[i].displayShort();
+            if (!currentUser)
+            {
+                cout << "\n---Hospital Management System---\n1. Log in\n2. Exit\nEnter choice: ";
+                int choice = getChoice(1, 2);
+                if (choice == 2)
+                {
+                    cout << "Goodbye!\n";
+                    running = false;
+                    break;
+                }
 
-            int id = 0;
-            bool validInput = false;
-            while (!validInput)
+                try
+                {
+                    login();
+                }
+                catch (InvalidCredentialsException &e)
+                {
+                    cout << e.what() << endl;
+                }
+                catch (std::exception &e)
+                {
+                    cout << "Error: " << e.what() << endl;
+                }
+            }
+            else
             {
                 try
                 {
-                    cout << "\nEnter patient ID to view (0 to cancel): ";
-                    string idStr;
-                    getline(cin, idStr);
+                    currentMenu->displayMenu();
+                    int choice;
 
-                    if (idStr.empty())
-                        throw InvalidInputException();
+                    if (dynamic_cast<Admin *>(currentUser))
+                        choice = getChoice(1, 8);
+                    else if (dynamic_cast<Doctor *>(currentUser))
+                        choice = getChoice(1, 10);
+                    else if (dynamic_cast<Receptionist *>(currentUser))
+                        choice = getChoice(1, 5);
 
-                    for (char c : idStr)
+                    if ((dynamic_cast<Admin *>(currentUser) && choice == 8) ||
+                        (dynamic_cast<Doctor *>(currentUser) && choice == 10) ||
+                        (dynamic_cast<Receptionist *>(currentUser) && choice == 5))
                     {
-                        if (!isdigit(c))
-                            throw InvalidInputException();
+                        delete currentUser;
+                        currentUser = nullptr;
+                        delete currentMenu;
+                        currentMenu = nullptr;
+                        StaffDirectory::setSessionPermissions(0);
+                        continue;
                     }
-
-                    id = stoi(idStr);
-
-                    validInput = true;
-                }
-                catch (InvalidInputException &e)
-                {
-                    cout << "Invalid input!";
+                    currentMenu->handleChoice(choice);
                 }
-                catch (std::out_of_range &e)
+                catch (HospitalException &e)
                 {
-                    cout << "ID value is too large! Please enter a smaller number.";
+                    cout << "Hospital system error: " << e.what() << endl;
                 }
                 catch (std::exception &e)
                 {
-                    cout << "An error occurred: " << e.what() << "\n";
+                    cout << "Error occurred: " << e.what() << endl;
                 }
             }
+        }
+    }
+};
 
-            if (id == 0)
-            {
-                delete[] patients;
-                return;
-            }
+// Replays a file of operations directly against the menu strategies, with
+// no prompts, across concurrent sessions and reports throughput and latency.
+// One operation per line ('#' starts a comment):
+//   login <username> <password>
+//   register <name>|<age>|<gender>|<address>|<contact>
+//   update <id>|<diagnosis>
+//   delete <id>
+//   view <id>
+// "$last" in place of an ID is the patient this session registered last.
+class ScriptRunner
+{
+    struct Operation
+    {
+        int kind;
+        string args;
+    };
 
-            bool found = false;
-            for (int i = 0; i < count; i++)
+    static const int kindCount = 5;
+    const char *kindNames[kindCount] = {"login", "register", "update", "delete", "view"};
+    vector<Operation> operations;
+    int sessions;
+    double rate;
+
+    mutex resultsLock;
+    vector<double> latencies[kindCount];
+    long long failures = 0;
+
+    static vector<string> split(const string &args, char delimiter)
+    {
+        vector<string> fields;
+        stringstream ss(args);
+        string field;
+        while (getline(ss, field, delimiter))
+            fields.push_back(field);
+        return fields;
+    }
+
+    static Validated<int> resolveId(const string &arg, int lastId)
+    {
+        if (arg == "$last")
+            return {lastId, lastId ? InputError::None : InputError::Empty};
+        return InputValidator::parseNumber(arg, 1, INT_MAX);
+    }
+
+    // Returns false when the operation was rejected
+    bool execute(const Operation &op, User *&user, MenuStrategy *&menu, int &lastId)
+    {
+        if (op.kind == 0)
+        {
+            vector<string> fields = split(op.args, ' ');
+            if (fields.size() != 2)
+                return false;
+            string role;
+            uint32_t permissions;
+            try
             {
-                if (patients[i].getId() == id)
-                {
-                    cout << "\nPatient Details:\nID: " << id << "\nName: " << patients[i].getName()
-                         << "\nAge: " << patients[i].getAge() << "\nGender: " << patients[i].getGender()
-                         << "\nAddress: " << patients[i].getAddress() << "\nContact: " << patients[i].getContactNumber() << endl;
-                    found = true;
-                    break;
-                }
+                permissions = StaffDirectory::getInstance()->authenticate(fields[0], fields[1], role);
             }
-
-            if (!found)
+            catch (InvalidCredentialsException &e)
             {
-                cout << "Patient not found with ID: " << id << "\n";
+                return false;
             }
-
-            delete[] patients;
+            delete menu;
+            delete user;
+            user = User::create(role, fields[0].c_str(), permissions);
+            menu = user->createMenuStrategy();
+            AuditTrail::setActor(user->getUsername());
+            StaffDirectory::setSessionPermissions(permissions);
+            return true;
         }
-        catch (PermissionDeniedException &e)
+
+        DoctorMenuStrategy *doctor = dynamic_cast<DoctorMenuStrategy *>(menu);
+        ReceptionistMenuStrategy *receptionist = dynamic_cast<ReceptionistMenuStrategy *>(menu);
+
+        if (op.kind == 1)
         {
-            cout << e.what() << endl;
+            vector<string> fields = split(op.args, '|');
+            if (!receptionist || (int)fields.size() != PatientSchema::enteredCount)
+                return false;
+            Validated<int> id = receptionist->registerPatient(fields);
+            if (id.ok())
+                lastId = id.value;
+            return id.ok();
         }
-        catch (HospitalException &e)
+
+        if (op.kind == 2)
         {
-            cout << "Hospital system error: " << e.what() << endl;
+            size_t bar = op.args.find('|');
+            if (!doctor || bar == string::npos)
+                return false;
+            Validated<int> id = resolveId(op.args.substr(0, bar), lastId);
+            if (!id.ok())
+                return false;
+            doctor->updateDiagnosis(id.value, op.args.substr(bar + 1));
+            return true;
         }
-        catch (std::exception &e)
+
+        Validated<int> id = resolveId(op.args, lastId);
+        if (!id.ok())
+            return false;
+        if (op.kind == 3)
         {
-            cout << "Unexpected error: " << e.what() << endl;
+            if (!doctor)
+                return false;
+            doctor->removePatient(id.value);
         }
+        else if (doctor)
+            doctor->viewPatient(id.value);
+        else if (receptionist)
+            receptionist->viewPatient(id.value);
+        else
+            return false;
+        return true;
     }
 
-    bool isWhiteSpace(const string &input)
+    void runSession()
     {
-        for (char c : input)
+        User *user = nullptr;
+        MenuStrategy *menu = nullptr;
+        int lastId = 0;
+        vector<double> local[kindCount];
+        long long localFailures = 0;
+
+        auto started = chrono::steady_clock::now();
+        for (size_t i = 0; i < operations.size(); i++)
         {
-            if (!isspace(c))
+            if (rate > 0)
+                this_thread::sleep_until(started + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(i / rate)));
+
+            auto opStarted = chrono::steady_clock::now();
+            bool ok;
+            try
             {
-                return false;
+                ok = execute(operations[i], user, menu, lastId);
+            }
+            catch (std::exception &e)
+            {
+                ok = false;
             }
+            local[operations[i].kind].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - opStarted).count());
+            if (!ok)
+                localFailures++;
+            // A queued write the writer later refused counts against whoever notices it
+            if (!StorageEngine::getInstance()->takeWriteError().empty())
+                localFailures++;
         }
-        return true;
+        delete menu;
+        delete user;
+
+        lock_guard<mutex> guard(resultsLock);
+        for (int k = 0; k < kindCount; k++)
+            latencies[k].insert(latencies[k].end(), local[k].begin(), local[k].end());
+        failures += localFailures;
     }
 
-    bool isValidReceptionistMenuInput(const string &input)
+    static double percentile(const vector<double> &sorted, double fraction)
+    {
+        return sorted[min(sorted.size() - 1, (size_t)(fraction * (double)sorted.size()))];
+    }
+
+public:
+    // rate is operations per second per session; 0 replays as fast as possible
+    ScriptRunner(const char *path, int sessions, double rate) : sessions(sessions), rate(rate)
     {
-        if (input.empty() || isWhiteSpace(input))
+        ifstream file(path);
+        if (!file)
+            throw FileOperationException("Could not open script file");
+
+        string line;
+        while (getline(file, line))
         {
-            return false;
+            if (line.empty() || line[0] == '#')
+                continue;
+            size_t space = line.find(' ');
+            string verb = line.substr(0, space);
+            int kind = 0;
+            while (kind < kindCount && verb != kindNames[kind])
+                kind++;
+            if (kind == kindCount || space == string::npos)
+                throw FileOperationException("Unknown operation in script file");
+            operations.push_back({kind, line.substr(space + 1)});
         }
+    }
 
-        for (char c : input)
+    void run()
+    {
+        StorageEngine::getInstance();
+        AuditTrail::getInstance();
+        TriageQueue::getInstance();
+        BedBoard::getInstance();
+
+        auto started = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (int i = 0; i < sessions; i++)
+            threads.emplace_back(&ScriptRunner::runSession, this);
+        for (thread &t : threads)
+            t.join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        auto flushStarted = chrono::steady_clock::now();
+        AuditTrail::getInstance()->shutdown();
+        StorageEngine::getInstance()->shutdown();
+        if (!StorageEngine::getInstance()->takeWriteError().empty())
+            failures++;
+        double flushMillis = chrono::duration<double, milli>(chrono::steady_clock::now() - flushStarted).count();
+
+        long long total = (long long)operations.size() * sessions;
+        cout << sessions << " session(s), " << total << " operations in " << seconds << " s ("
+             << total / seconds << " ops/s), " << failures << " rejected; final flush " << flushMillis << " ms\n";
+        cout << "Latency (us)      count      p50      p99      max\n";
+        for (int k = 0; k < kindCount; k++)
         {
-            if (!isdigit(c))
-            {
-                return false;
-            }
+            if (latencies[k].empty())
+                continue;
+            sort(latencies[k].begin(), latencies[k].end());
+            cout << "  " << kindNames[k] << string(16 - strlen(kindNames[k]), ' ') << latencies[k].size() << "  "
+                 << percentile(latencies[k], 0.5) << "  " << percentile(latencies[k], 0.99) << "  " << latencies[k].back() << "\n";
         }
+    }
+};
 
-        try
+// Streams a snapshot of the registry to CSV or JSON Lines. One thread reads
+// snapshot chunks, a pool formats them, and the writer emits them in ID
+// order in 1 MiB writes. Only a fixed number of chunks is in flight at any
+// time, so memory stays flat however large the registry is.
+class RegistryExporter
+{
+    struct Batch
+    {
+        long long seq;
+        vector<Patient> patients;
+        string text;
+    };
+
+    static const size_t writeSize = 1 << 20;
+    bool csv;
+    int threads;
+    size_t maxInFlight;
+
+    mutex lock;
+    condition_variable changed;
+    deque<Batch *> toFormat;
+    map<long long, Batch *> formatted;
+    size_t inFlight = 0;
+    bool reading = true;
+    long long written = 0;
+
+    // RFC 4180: quote only fields holding a delimiter, quote or line break
+    static void appendCsv(string &out, const char *field)
+    {
+        if (!strpbrk(field, ",\"\r\n"))
         {
-            int choice = stoi(input);
-            return (choice >= 1 && choice <= 3);
+            out += field;
+            return;
         }
-        catch (const std::exception &)
+        out += '"';
+        for (const char *c = field; *c; c++)
         {
-            return false;
+            if (*c == '"')
+                out += '"';
+            out += *c;
         }
+        out += '"';
     }
 
-    void execute()
+    static void appendJson(string &out, const char *field)
     {
-        while (true)
+        static const char digits[] = "0123456789abcdef";
+        out += '"';
+        for (const char *c = field; *c; c++)
         {
-            cout << "\n------- Receptionist Menu --------\n";
-            cout << "1. View Records\n";
-            cout << "2. Register Patient\n";
-            cout << "3. Back\n";
-            cout << "Enter your choice: ";
-
-            string input;
-            getline(cin, input);
-
-            if (!isValidReceptionistMenuInput(input))
+            unsigned char ch = (unsigned char)*c;
+            if (ch == '"' || ch == '\\')
             {
-                cout << "Invalid input! Please enter only numbers between 1-3.\n";
-                continue;
+                out += '\\';
+                out += (char)ch;
             }
-
-            int choice = stoi(input);
-
-            switch (choice)
+            else if (ch < 0x20)
             {
-            case 1:
-                viewRecords();
-                break;
-            case 2:
-                registerPatient();
-                break;
-            case 3:
-                return;
-            default:
-                // This should never execute due to validation
-                cout << "Invalid choice. Please try again.\n";
+                out += "\\u00";
+                out += digits[ch >> 4];
+                out += digits[ch & 15];
             }
+            else
+                out += (char)ch;
         }
+        out += '"';
     }
 
-    void registerPatient()
+    void format(Batch &batch) const
     {
-        try
+        batch.text.reserve(batch.patients.size() * 128);
+        string &out = batch.text;
+        string value;
+        for (const Patient &p : batch.patients)
         {
-            // Check permission
-            FileHandler *fh = FileHandler::getInstance();
-            int count;
-            bool *rights = fh->getAccessRights("Receptionist", count);
-
-            if (!rights[0])
-            {
-                delete[] rights;
-                throw PermissionDeniedException();
-            }
-            delete[] rights;
-
-            int id = fh->getNextPatientId();
-
-            cout << "\nPatient Registration\n--------------------------\n";
-            string name, addr, contact;
-            int age;
-            char gender;
-
-            auto isWhiteSpace = [](const string &str) -> bool
-            {
-                for (char c : str)
-                {
-                    if (!isspace(c))
-                    {
-                        return false;
-                    }
-                }
-                return true;
-            };
-
-            bool validInput = false;
-            while (!validInput)
-            {
-                try
-                {
-                    cout << "Name: ";
-                    getline(cin, name);
-
-                    if (name.empty() || isWhiteSpace(name))
-                        throw InvalidInputException();
-
-                    for (char c : name)
-                    {
-                        if (!isalpha(c) && !isspace(c))
-                            throw InvalidInputException();
-                    }
-                    validInput = true;
-                }
-                catch (InvalidInputException &e)
-                {
-                    cout << "Invalid input!\n";
-                }
-            }
-
-            validInput = false;
-            while (!validInput)
-            {
-                try
+            bool first = true;
+            out += csv ? "" : "{";
+            PatientSchema::forEach([&](auto field)
+                                   {
+                using Field = decltype(field);
+                if (!first)
+                    out += ',';
+                first = false;
+                if (!csv)
                 {
-                    cout << "Age: ";
-                    string ageStr;
-                    getline(cin, ageStr);
-
-                    if (ageStr.empty())
-                        throw InvalidInputException();
-
-                    for (char c : ageStr)
-                    {
-                        if (!isdigit(c))
-                            throw InvalidInputException();
-                    }
-
-                    age = stoi(ageStr);
-                    if (age <= 0 || age > 150)
-                        throw InvalidInputException();
-
-                    validInput = true;
+                    out += '"';
+                    out += Field::key;
+                    out += "\":";
                 }
-                catch (InvalidInputException &e)
+                if constexpr (PatientSchema::isInteger<Field>())
+                    PatientSchema::appendValue<Field>(out, p);
+                else
                 {
-                    cout << "Invalid input!\n";
-                }
-            }
+                    value.clear();
+                    PatientSchema::appendValue<Field>(value, p);
+                    csv ? appendCsv(out, value.c_str()) : appendJson(out, value.c_str());
+                } });
+            out += csv ? "\r\n" : "}\n";
+        }
+        batch.patients = vector<Patient>();
+    }
 
-            validInput = false;
-            while (!validInput)
+    void formatLoop()
+    {
+        while (true)
+        {
+            Batch *batch;
             {
-                try
-                {
-                    cout << "Gender (M/F/O): ";
-                    string genderStr;
-                    getline(cin, genderStr);
-
-                    if (genderStr.length() != 1)
-                        throw InvalidInputException();
-
-                    gender = toupper(genderStr[0]);
-                    if (gender != 'M' && gender != 'F' && gender != 'O')
-                        throw InvalidInputException();
-
-                    validInput = true;
-                }
-                catch (InvalidInputException &e)
-                {
-                    cout << "Invalid input!\n";
-                }
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [this]
+                             { return !toFormat.empty() || !reading; });
+                if (toFormat.empty())
+                    return;
+                batch = toFormat.front();
+                toFormat.pop_front();
             }
+            format(*batch);
+            lock_guard<mutex> guard(lock);
+            formatted[batch->seq] = batch;
+            changed.notify_all();
+        }
+    }
 
-            validInput = false;
-            while (!validInput)
+    void writeLoop(ofstream &file, long long &bytes)
+    {
+        string buffer;
+        buffer.reserve(writeSize * 2);
+        while (true)
+        {
+            Batch *batch;
             {
-                try
-                {
-                    cout << "Address: ";
-                    getline(cin, addr);
-
-                    if (addr.empty() || isWhiteSpace(addr))
-                        throw InvalidInputException();
-
-                    for (char c : addr)
-                    {
-                        if (!isalnum(c) && !isspace(c) && c != ',' && c != '.' && c != '-' && c != '/' && c != '#')
-                            throw InvalidInputException();
-                    }
-                    validInput = true;
-                }
-                catch (InvalidInputException &e)
-                {
-                    cout << "Invalid input!\n";
-                }
+                unique_lock<mutex> guard(lock);
+                changed.wait(guard, [this]
+                             { return (!formatted.empty() && formatted.begin()->first == written) ||
+                                      (!reading && inFlight == 0); });
+                if (formatted.empty() || formatted.begin()->first != written)
+                    break;
+                batch = formatted.begin()->second;
+                formatted.erase(formatted.begin());
             }
 
-            validInput = false;
-            while (!validInput)
+            buffer += batch->text;
+            delete batch;
+            if (buffer.size() >= writeSize)
             {
-                try
-                {
-                    cout << "Contact: ";
-                    getline(cin, contact);
-
-                    if (contact.empty())
-                        throw InvalidInputException();
-
-                    for (char c : contact)
-                    {
-                        if (!isdigit(c))
-                            throw InvalidInputException();
-                    }
-                    validInput = true;
-                }
-                catch (InvalidInputException &e)
-                {
-                    cout << "Invalid input!\n";
-                }
+                file.write(buffer.data(), (streamsize)buffer.size());
+                bytes += (long long)buffer.size();
+                buffer.clear();
             }
 
-            Patient p(id, name.c_str(), age, toupper(gender), addr.c_str(), contact.c_str());
-            fh->savePatient(p);
-            cout << "Patient registered with ID: " << id << endl;
-        }
-        catch (PermissionDeniedException &e)
-        {
-            cout << e.what() << endl;
+            lock_guard<mutex> guard(lock);
+            written++;
+            inFlight--;
+            changed.notify_all();
         }
+        file.write(buffer.data(), (streamsize)buffer.size());
+        bytes += (long long)buffer.size();
     }
 
 public:
-    void displayMenu() override
-    {
-        cout << "\n---Receptionist Menu---\n";
-        cout << "1. View records\n";
-        cout << "2. Register patient\n";
-        cout << "3. Back\nEnter your choice: ";
-    }
+    RegistryExporter(bool csv, int threads) : csv(csv), threads(threads), maxInFlight((size_t)threads * 2 + 2) {}
 
-    void handleChoice(int choice) override
+    // Returns the number of patients written; bytes is set to the file size
+    long long run(const char *path, long long &bytes)
     {
-        switch (choice)
+        ofstream file(path, ios::binary | ios::trunc);
+        if (!file)
+            throw FileOperationException("Could not open export file");
+        bytes = 0;
+        string header;
+        if (csv)
         {
-        case 1:
-            viewRecords();
-            break;
-        case 2:
-            registerPatient();
-            break;
+            PatientSchema::forEach([&](auto field)
+                                   { header += (header.empty() ? "" : ",") + string(decltype(field)::key); });
+            header += "\r\n";
+        }
+        file.write(header.data(), (streamsize)header.size());
+        bytes += (long long)header.size();
+
+        vector<thread> formatters;
+        for (int t = 0; t < threads; t++)
+            formatters.emplace_back(&RegistryExporter::formatLoop, this);
+        thread writer(&RegistryExporter::writeLoop, this, ref(file), ref(bytes));
+
+        StorageEngine *fh = StorageEngine::getInstance();
+        long long snapshot = fh->beginSnapshot(), exported = 0, seq = 0;
+        int fromId = INT_MIN;
+        bool more = true;
+        while (more)
+        {
+            Batch *batch = new Batch{seq++, {}, {}};
+            more = fh->readSnapshot(snapshot, fromId, batch->patients);
+            exported += (long long)batch->patients.size();
+
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [this]
+                         { return inFlight < maxInFlight; });
+            toFormat.push_back(batch);
+            inFlight++;
+            changed.notify_all();
+        }
+        fh->endSnapshot(snapshot);
+
+        {
+            lock_guard<mutex> guard(lock);
+            reading = false;
+            changed.notify_all();
         }
+        for (thread &t : formatters)
+            t.join();
+        writer.join();
+
+        file.close();
+        if (!file)
+            throw FileOperationException("Could not write export file");
+        return exported;
     }
 };
 
-class Admin : public User
+// Compares the old throw-per-bad-keystroke parsing with InputValidator on
+// mostly invalid input, which is what bulk and scripted entry looks like
+void runValidationBenchmark()
 {
-public:
-    Admin() : User("Admin", "admin") {}
-    MenuStrategy *createMenuStrategy() override { return new AdminMenuStrategy(); }
-};
+    const string samples[] = {"abc", "", "12a", "99999999999", "0", " 3", "17", "4"};
+    const int sampleCount = sizeof samples / sizeof samples[0], iterations = 200000;
 
-class Doctor : public User
+    auto throwingParse = [](const string &input, int min, int max) -> int
+    {
+        try
+        {
+            if (input.empty())
+                throw InvalidInputException();
+            for (char c : input)
+            {
+                if (!isdigit(c))
+                    throw InvalidInputException();
+            }
+            int value = stoi(input);
+            if (value < min || value > max)
+                throw InvalidInputException();
+            return value;
+        }
+        catch (InvalidInputException &e)
+        {
+            return -1;
+        }
+        catch (std::out_of_range &e)
+        {
+            return -2;
+        }
+    };
+
+    long long acceptedThrowing = 0, acceptedValidated = 0;
+    auto started = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        acceptedThrowing += throwingParse(samples[i % sampleCount], 1, 9) > 0;
+    double throwingNs = chrono::duration<double, nano>(chrono::steady_clock::now() - started).count() / iterations;
+
+    started = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        acceptedValidated += InputValidator::parseNumber(samples[i % sampleCount], 1, 9).ok();
+    double validatedNs = chrono::duration<double, nano>(chrono::steady_clock::now() - started).count() / iterations;
+
+    cout << "Validation benchmark: " << iterations << " inputs, "
+         << 100 - 100 * acceptedValidated / iterations << "% invalid\n"
+         << "  exceptions:     " << throwingNs << " ns/input (" << acceptedThrowing << " accepted)\n"
+         << "  InputValidator: " << validatedNs << " ns/input (" << acceptedValidated << " accepted)\n";
+}
+
+// Times the schema-generated record format against the stringstream and
+// to_string code Patient used before, on the same in-memory records.
+void runSchemaBenchmark(int count)
 {
-public:
-    Doctor() : User("Doctor", "doctor") {}
-    MenuStrategy *createMenuStrategy() override { return new DoctorMenuStrategy(); }
-};
+    auto legacyToString = [](const Patient &p)
+    {
+        return to_string(p.getId()) + "|" + p.getName() + "|" + to_string(p.getAge()) + "|" + p.getGender() + "|" +
+               p.getAddress() + "|" + p.getContactNumber() + "|" + p.getDiagnosis();
+    };
+    auto legacyFromString = [](Patient &p, const string &str)
+    {
+        stringstream ss(str);
+        string token;
+        getline(ss, token, '|');
+        p.setId(stoi(token));
+        getline(ss, token, '|');
+        p.setName(token.c_str());
+        getline(ss, token, '|');
+        p.setAge(stoi(token));
+        getline(ss, token, '|');
+        p.setGender(token[0]);
+        getline(ss, token, '|');
+        p.setAddress(token.c_str());
+        getline(ss, token, '|');
+        p.setContactNumber(token.c_str());
+        getline(ss, token);
+        p.setDiagnosis(token.c_str());
+    };
+
+    const char *names[] = {"Maria Santos", "Jose Reyes", "Ana Cruz", "Juan Dela Cruz", "Liza Bautista"};
+    const char *diagnoses[] = {"", "flu", "hypertension", "type 2 diabetes", "asthma|mild"};
+    const char genders[] = {'M', 'F', 'O'};
+    vector<Patient> patients;
+    patients.reserve(count);
+    for (int i = 0; i < count; i++)
+        patients.emplace_back(i + 1, names[i % 5], 1 + i % 100, genders[i % 3], "12 Rizal St., Manila",
+                              to_string(9170000000LL + i).c_str(), diagnoses[i % 5]);
+
+    auto timeMs = [](auto work)
+    {
+        auto started = chrono::steady_clock::now();
+        work();
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+    };
+
+    vector<string> legacy(count), generated(count);
+    double legacyWrite = timeMs([&]
+                                { for (int i = 0; i < count; i++) legacy[i] = legacyToString(patients[i]); });
+    double generatedWrite = timeMs([&]
+                                   { for (int i = 0; i < count; i++) generated[i] = patients[i].toString(); });
+
+    Patient scratch;
+    double legacyRead = timeMs([&]
+                               { for (int i = 0; i < count; i++) legacyFromString(scratch, legacy[i]); });
+    double generatedRead = timeMs([&]
+                                  { for (int i = 0; i < count; i++) scratch.fromString(generated[i]); });
+
+    int mismatches = 0;
+    for (int i = 0; i < count; i++)
+    {
+        scratch.fromString(legacy[i]);
+        mismatches += legacy[i] != generated[i] || scratch.toString() != legacy[i];
+    }
 
-class Receptionist : public User
-{
-public:
-    Receptionist() : User("Receptionist", "receptionist") {}
-    MenuStrategy *createMenuStrategy() override { return new ReceptionistMenuStrategy(); }
-};
+    cout << fixed << setprecision(1) << "Schema benchmark: " << count << " records, " << mismatches << " mismatches\n"
+         << "                serialize       parse   (ns/record)\n"
+         << "  stringstream " << setw(11) << legacyWrite * 1e6 / count << setw(12) << legacyRead * 1e6 / count << "\n"
+         << "  schema       " << setw(11) << generatedWrite * 1e6 / count << setw(12) << generatedRead * 1e6 / count << "\n";
+}
 
-class Hospital
+// Read-only station: serves view and search from a ReplicaStore
+void runFollower(int maxStalenessMs)
 {
-    User *currentUser = nullptr;
-    MenuStrategy *currentMenu = nullptr;
+    ReplicaStore replica{chrono::milliseconds(maxStalenessMs)};
+    cout << "Follower ready: " << replica.size() << " patient(s), change seq " << replica.getAppliedSeq()
+         << ", staleness bound " << maxStalenessMs << " ms\n";
 
-    int getChoice(int min, int max)
+    while (true)
     {
-        string choiceStr;
-        int choice = 0;
-        bool validInput = false;
+        cout << "\n---Follower Menu---\n1. View patient\n2. Search by name\n3. Replica status\n4. Exit\nEnter your choice: ";
+        string input;
+        if (!getline(cin, input))
+            return;
+        Validated<int> choice = InputValidator::parseNumber(input, 1, 4);
+        if (!choice.ok())
+        {
+            cout << "Invalid choice. Try again.\n";
+            continue;
+        }
 
-        while (!validInput)
+        if (choice.value == 1)
         {
-            try
-            {
-                getline(cin, choiceStr);
+            cout << "Enter patient ID: ";
+            getline(cin, input);
+            Validated<int> id = InputValidator::parseNumber(input, 1, INT_MAX);
+            Patient p;
+            if (id.ok() && replica.find(id.value, p))
+                p.display();
+            else
+                cout << "Patient not found.\n";
+        }
+        else if (choice.value == 2)
+        {
+            cout << "Enter part of the name: ";
+            getline(cin, input);
+            vector<Patient> hits = replica.searchByName(input);
+            for (const Patient &p : hits)
+                p.displayShort();
+            cout << hits.size() << " match(es).\n";
+        }
+        else if (choice.value == 3)
+            cout << replica.size() << " patient(s), change seq " << replica.getAppliedSeq() << ", last sync "
+                 << replica.millisSinceSync() << " ms ago\n";
+        else
+            return;
+    }
+}
 
-                if (choiceStr.empty())
-                    throw InvalidInputException();
+// Offline integrity check of patients.txt; run it while the system is down.
+// The file is split into byte ranges on line boundaries, one per thread.
+// With repair, damaged lines go to patients.quarantine and every good record
+// is rewritten with a checksum.
+void runFsck(int threads, bool repair)
+{
+    ifstream in("patients.txt", ios::binary | ios::ate);
+    if (!in)
+    {
+        cout << "No patients.txt to check.\n";
+        return;
+    }
+    string data((size_t)in.tellg(), '\0');
+    in.seekg(0);
+    in.read(&data[0], (streamsize)data.size());
+    in.close();
+
+    vector<size_t> bounds(threads + 1, data.size());
+    bounds[0] = 0;
+    for (int t = 1; t < threads; t++)
+    {
+        size_t newline = data.find('\n', max(bounds[t - 1], data.size() * t / threads));
+        bounds[t] = newline == string::npos ? data.size() : newline + 1;
+    }
 
-                for (char c : choiceStr)
+    struct Range
+    {
+        long long lines = 0, sealed = 0, legacy = 0;
+        vector<long long> badLines; // line numbers within the range
+        vector<string> good, bad;
+        vector<uint32_t> versions; // of the good records
+    };
+    vector<Range> ranges(threads);
+
+    auto started = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.emplace_back([&, t]
+                             {
+            Range &range = ranges[t];
+            string line, record;
+            uint32_t version;
+            for (size_t pos = bounds[t]; pos < bounds[t + 1];)
+            {
+                size_t end = min(data.find('\n', pos), bounds[t + 1]);
+                line.assign(data, pos, end - pos);
+                pos = end + 1;
+                range.lines++;
+                if (line.empty() || line == "\r")
+                    continue;
+
+                RecordChecksum::State state = RecordChecksum::open(line, record, &version);
+                if (state == RecordChecksum::Corrupt)
+                {
+                    range.badLines.push_back(range.lines);
+                    if (repair)
+                        range.bad.push_back(line);
+                    continue;
+                }
+                (state == RecordChecksum::Sealed ? range.sealed : range.legacy)++;
+                if (repair)
                 {
-                    if (!isdigit(c))
-                        throw InvalidInputException();
+                    range.good.push_back(record);
+                    range.versions.push_back(version);
                 }
+            } });
+    for (thread &worker : workers)
+        worker.join();
+    double millis = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
 
-                choice = stoi(choiceStr);
+    long long lines = 0, sealed = 0, legacy = 0, bad = 0;
+    for (const Range &range : ranges)
+    {
+        for (long long line : range.badLines)
+            if (bad++ < 20)
+                cout << "  line " << lines + line << ": checksum mismatch or malformed record\n";
+        lines += range.lines;
+        sealed += range.sealed;
+        legacy += range.legacy;
+    }
+    cout << "Checked " << sealed + legacy + bad << " record(s), " << data.size() / 1024 << " KiB, with " << threads
+         << " thread(s) in " << millis << " ms (" << (millis > 0 ? data.size() / 1048.576 / millis : 0) << " MiB/s)\n"
+         << "  " << sealed << " with checksum, " << legacy << " without, " << bad << " damaged\n";
 
-                if (choice < min || choice > max)
-                    throw InvalidInputException();
+    if (!repair || (!bad && !legacy))
+        return;
 
-                validInput = true;
-            }
-            catch (InvalidInputException &e)
-            {
-                cout << "Invalid input. Enter a number between " << min << " and " << max << ": ";
-            }
-            catch (std::out_of_range &e)
-            {
-                cout << "Number too large! Enter a number between " << min << " and " << max << ": ";
-            }
-            catch (std::exception &e)
+    ofstream quarantine("patients.quarantine", ios::app);
+    ofstream out("patients.txt.tmp");
+    for (const Range &range : ranges)
+    {
+        for (const string &line : range.bad)
+            quarantine << line << "\n";
+        for (size_t i = 0; i < range.good.size(); i++)
+            out << RecordChecksum::seal(range.good[i], range.versions[i]) << "\n";
+    }
+    quarantine.close();
+    out.close();
+    if (!quarantine || !out)
+    {
+        cout << "Repair failed: could not write the repaired files\n";
+        remove("patients.txt.tmp");
+        return;
+    }
+    // rename replaces patients.txt in one step, so a crash leaves one or the other
+    if (rename("patients.txt.tmp", "patients.txt") != 0)
+    {
+        cout << "Repair failed: could not replace patients.txt\n";
+        remove("patients.txt.tmp");
+        return;
+    }
+    cout << "Repaired: " << bad << " damaged line(s) moved to patients.quarantine, " << legacy << " record(s) given checksums\n";
+}
+
+// Resident set size, where the platform exposes it cheaply; -1 otherwise
+long long residentBytes()
+{
+#ifdef __linux__
+    ifstream statm("/proc/self/statm");
+    long long pages, resident;
+    if (statm >> pages >> resident)
+        return resident * sysconf(_SC_PAGESIZE);
+#endif
+    return -1;
+}
+
+// Memory report for address/diagnosis storage: pool handles against a
+// private new[] copy per record, on a synthetic registry of the given size
+void runInterningBenchmark(int records)
+{
+    const char *streets[] = {"Oak Ave", "Pine St", "Maple Rd", "Cedar Ln", "Elm St", "Rizal Ave", "Mabini St", "Bonifacio Dr",
+                             "Luna St", "Del Pilar St", "Quezon Blvd", "Taft Ave", "Roxas Blvd", "Aurora Blvd", "Shaw Blvd"};
+    const char *cities[] = {"Manila", "Quezon City", "Makati", "Pasig", "Taguig", "Cebu City", "Davao City", "Iloilo City",
+                            "Baguio", "Cavite", "Laguna", "Batangas"};
+    const char *diagnoses[] = {"", "Hypertension", "Type 2 diabetes", "Asthma", "Upper respiratory infection", "Influenza",
+                               "Dengue fever", "Pneumonia", "Urinary tract infection", "Gastroenteritis", "Migraine",
+                               "Allergic rhinitis", "Tuberculosis", "Anemia", "Hypothyroidism", "Osteoarthritis",
+                               "Chronic kidney disease", "Acid reflux", "Dermatitis", "Sprained ankle"};
+    const int streetCount = sizeof streets / sizeof streets[0], cityCount = sizeof cities / sizeof cities[0];
+    const int diagnosisCount = sizeof diagnoses / sizeof diagnoses[0];
+
+    auto address = [&](int i)
+    {
+        return to_string(1 + i % 150) + " " + streets[(i / 150) % streetCount] + ", " + cities[(i / 7) % cityCount];
+    };
+    auto diagnosis = [&](int i)
+    { return diagnoses[(i * 2654435761u >> 16) % diagnosisCount]; };
+
+    StringPool *pool = StringPool::getInstance();
+    long long before = residentBytes();
+    vector<uint32_t> addressIds(records), diagnosisIds(records);
+    for (int i = 0; i < records; i++)
+    {
+        addressIds[i] = pool->intern(address(i).c_str());
+        diagnosisIds[i] = pool->intern(diagnosis(i));
+    }
+    long long interned = residentBytes() - before;
+    size_t distinct, poolBytes;
+    pool->report(distinct, poolBytes);
+
+    before = residentBytes();
+    vector<char *> addressCopies(records), diagnosisCopies(records);
+    size_t copyBytes = 0;
+    for (int i = 0; i < records; i++)
+    {
+        string a = address(i);
+        const char *d = diagnosis(i);
+        addressCopies[i] = new char[a.size() + 1];
+        strcpy(addressCopies[i], a.c_str());
+        diagnosisCopies[i] = new char[strlen(d) + 1];
+        strcpy(diagnosisCopies[i], d);
+        copyBytes += a.size() + strlen(d) + 2;
+    }
+    long long copied = residentBytes() - before;
+
+    // Equality filter: string compare per record against one handle compare
+    const char *wanted = "Dengue fever";
+    auto started = chrono::steady_clock::now();
+    int byText = 0;
+    for (int i = 0; i < records; i++)
+        byText += strcmp(diagnosisCopies[i], wanted) == 0;
+    double textMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+    started = chrono::steady_clock::now();
+    int byHandle = 0;
+    uint32_t handle;
+    if (pool->lookup(wanted, handle))
+        for (int i = 0; i < records; i++)
+            byHandle += diagnosisIds[i] == handle;
+    double handleMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+
+    for (int i = 0; i < records; i++)
+    {
+        delete[] addressCopies[i];
+        delete[] diagnosisCopies[i];
+    }
+
+    cout << "Interning benchmark: " << records << " records, " << distinct << " distinct address/diagnosis values\n"
+         << "  private copies: " << copyBytes / 1024 << " KiB of text";
+    if (copied >= 0)
+        cout << ", " << copied / 1024 << " KiB resident";
+    cout << "\n  interned:       " << poolBytes / 1024 << " KiB of text + " << 2 * sizeof(uint32_t) * records / 1024 << " KiB of handles";
+    if (interned >= 0)
+        cout << ", " << interned / 1024 << " KiB resident";
+    cout << "\n  filter \"" << wanted << "\": strcmp " << textMs << " ms (" << byText << " hits), handle compare "
+         << handleMs << " ms (" << byHandle << " hits)\n";
+}
+
+// Each replica stands in for a follower process with its own copy and lock;
+// one reader thread per replica shows how read throughput scales with them
+void runReplicaBenchmark(int maxReplicas)
+{
+    const double seconds = 2;
+    for (int replicas = 1; replicas <= maxReplicas; replicas *= 2)
+    {
+        vector<unique_ptr<ReplicaStore>> stores;
+        for (int i = 0; i < replicas; i++)
+            stores.emplace_back(new ReplicaStore(chrono::milliseconds(100)));
+        vector<int> ids = stores[0]->ids();
+        if (ids.empty())
+        {
+            cout << "No patients to read; register some first.\n";
+            return;
+        }
+
+        atomic<long long> reads(0);
+        atomic<bool> stop(false);
+        vector<thread> readers;
+        for (int r = 0; r < replicas; r++)
+            readers.emplace_back([&, r]
+                                 {
+                ReplicaStore &store = *stores[r];
+                uint32_t state = 2463534242u + r;
+                Patient p;
+                long long local = 0;
+                while (!stop)
+                {
+                    state ^= state << 13;
+                    state ^= state >> 17;
+                    state ^= state << 5;
+                    store.find(ids[state % ids.size()], p);
+                    local++;
+                }
+                reads += local; });
+        this_thread::sleep_for(chrono::duration<double>(seconds));
+        stop = true;
+        for (thread &t : readers)
+            t.join();
+
+        double staleness = 0;
+        for (auto &store : stores)
+            staleness = max(staleness, store->millisSinceSync());
+        cout << "  " << replicas << " replica(s): " << (long long)(reads / seconds) << " views/s, max time since sync "
+             << staleness << " ms\n";
+    }
+}
+
+// Monitor-style feed: every patient reports every metric once a second with
+// a little jitter, ingested on one thread
+void runVitalsBenchmark(long long samples)
+{
+    const int patients = 100;
+    // Synthetic readings stay out of vitals.dat and off real patients' charts
+    VitalsStore scratch(nullptr);
+    VitalsStore *store = &scratch;
+    size_t startSamples, startBytes;
+    store->report(startSamples, startBytes);
+    int64_t start = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    int64_t rounds = samples / (patients * VITAL_METRIC_COUNT) + 1;
+    int64_t epoch = start - rounds * 1000;
+    const int baseline[VITAL_METRIC_COUNT] = {75, 120, 80, 368, 97};
+    uint32_t state = 2463534242u;
+    auto next = [&state]
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+
+    long long recorded = 0;
+    auto begin = chrono::steady_clock::now();
+    for (int64_t round = 0; recorded < samples; round++)
+        for (int p = 1; p <= patients && recorded < samples; p++)
+            for (int m = 0; m < VITAL_METRIC_COUNT && recorded < samples; m++)
             {
-                cout << "An error occurred: " << e.what() << "\nEnter a number between " << min << " and " << max << ": ";
+                int64_t time = epoch + round * 1000 + next() % 50;
+                int value = baseline[m] + (int)(next() % 5) - 2;
+                recorded += store->record(p, (VitalMetric)m, time, value);
             }
+    double ingestSeconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    size_t totalSamples, totalBytes;
+    store->report(totalSamples, totalBytes);
+    cout << "Ingested " << recorded << " samples in " << ingestSeconds * 1000 << " ms ("
+         << (long long)(recorded / ingestSeconds) << " samples/s), "
+         << (double)(totalBytes - startBytes) / max<size_t>(1, totalSamples - startSamples) << " bytes/sample\n";
+
+    // One-hour windows at random offsets, so both edges usually cut a chunk
+    const int queries = 10000;
+    long long matched = 0;
+    begin = chrono::steady_clock::now();
+    for (int q = 0; q < queries; q++)
+    {
+        int64_t from = epoch + (int64_t)(next() % max<int64_t>(1, rounds)) * 1000;
+        matched += store->query(next() % patients + 1, (VitalMetric)(next() % VITAL_METRIC_COUNT), from, from + 3600 * 1000).count;
+    }
+    double queryMs = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+    cout << queries << " one-hour window queries: " << queryMs * 1000 / queries << " us each, " << matched / queries
+         << " samples per window on average\n";
+    store->shutdown();
+}
+
+// Admission churn at 95% occupancy: each step discharges a random patient and
+// admits the next one to the lowest free bed, found with the bitmap or by
+// scanning every bed the way a plain occupancy array would.
+void runBedBenchmark(int bedCount, int steps)
+{
+    auto churn = [&](bool bitmap, long long &checksum)
+    {
+        mt19937 random(42);
+        HierarchicalBitmap free;
+        free.reset(bedCount);
+        vector<char> taken(bedCount, 0);
+        vector<int> occupied;
+        auto admit = [&]
+        {
+            int bed = -1;
+            if (bitmap)
+                bed = free.findFirst();
+            else
+                for (int b = 0; b < bedCount && bed < 0; b++)
+                    if (!taken[b])
+                        bed = b;
+            free.clear(bed);
+            taken[bed] = 1;
+            occupied.push_back(bed);
+            return bed;
+        };
+        while ((int)occupied.size() < bedCount * 95 / 100)
+            admit();
+
+        checksum = 0;
+        auto started = chrono::steady_clock::now();
+        for (int i = 0; i < steps; i++)
+        {
+            size_t pick = random() % occupied.size();
+            int bed = occupied[pick];
+            occupied[pick] = occupied.back();
+            occupied.pop_back();
+            free.set(bed);
+            taken[bed] = 0;
+            checksum += admit();
+        }
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - started).count() / steps;
+    };
+
+    long long scanSum, bitmapSum;
+    double scanNs = churn(false, scanSum), bitmapNs = churn(true, bitmapSum);
+    cout << fixed << setprecision(1) << "Bed benchmark: " << bedCount << " beds, " << steps << " discharge/admit steps"
+         << (scanSum == bitmapSum ? "" : ", RESULTS DIFFER") << "\n"
+         << "  linear scan: " << setw(9) << scanNs << " ns/step\n"
+         << "  bitmap:      " << setw(9) << bitmapNs << " ns/step\n";
+}
+
+int main(int argc, char *argv[])
+{
+    // --track-memory may appear anywhere; it must be on before the first allocation
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--track-memory") == 0)
+            MemoryAccounting::enable();
+
+    // --engine text|memory may follow any mode's own arguments
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--engine") == 0 && !StorageEngine::select(argv[i + 1]))
+        {
+            cout << "Unknown storage engine: " << argv[i + 1] << " (expected text or memory)\n";
+            return 1;
         }
 
-        return choice;
+    if (argc > 1 && strcmp(argv[1], "--bench-validation") == 0)
+    {
+        runValidationBenchmark();
+        return 0;
     }
 
-    void login(int role)
+    // --script <file> [--sessions N] [--rate ops-per-second-per-session]
+    if (argc > 2 && strcmp(argv[1], "--script") == 0)
     {
-        string username, password;
-        if (role == 1)
-            username = "Admin";
-        else if (role == 2)
-            username = "Doctor";
-        else if (role == 3)
-            username = "Receptionist";
-
-        cout << "User: " << username << "\nEnter password: ";
-        getline(cin, password);
+        int sessions = 1;
+        double rate = 0;
+        for (int i = 3; i + 1 < argc; i += 2)
+        {
+            if (strcmp(argv[i], "--sessions") == 0)
+                sessions = max(1, atoi(argv[i + 1]));
+            else if (strcmp(argv[i], "--rate") == 0)
+                rate = atof(argv[i + 1]);
+        }
 
-        if ((role == 1 && password == "admin") ||
-            (role == 2 && password == "doctor") ||
-            (role == 3 && password == "receptionist"))
+        try
         {
-            if (role == 1)
-                currentUser = new Admin();
-            else if (role == 2)
-                currentUser = new Doctor();
-            else if (role == 3)
-                currentUser = new Receptionist();
-            cout << "Login successful!\n";
-            currentMenu = currentUser->createMenuStrategy();
+            ScriptRunner(argv[2], sessions, rate).run();
         }
-        else
-            throw InvalidCredentialsException();
+        catch (std::exception &e)
+        {
+            cout << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
     }
 
-public:
-    ~Hospital()
+    // --fsck [--repair] [--threads N]
+    if (argc > 1 && strcmp(argv[1], "--fsck") == 0)
     {
-        delete currentUser;
-        delete currentMenu;
+        bool repair = false;
+        int threads = max(1, (int)thread::hardware_concurrency());
+        for (int i = 2; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--repair") == 0)
+                repair = true;
+            else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                threads = max(1, atoi(argv[++i]));
+        }
+        runFsck(threads, repair);
+        return 0;
     }
 
-    void start()
+    // --bench-interning [records]
+    if (argc > 1 && strcmp(argv[1], "--bench-interning") == 0)
     {
-        bool running = true;
-        while (running)
-        {
-            if (!currentUser)
-            {
-                cout << "\n---Hospital Management System---\n1. Admin\n2. Doctor\n3. Receptionist\n4. Exit\nEnter choice: ";
-                int choice = getChoice(1, 4);
-                if (choice == 4)
-                {
-                    cout << "Goodbye!\n";
-                    running = false;
-                    break;
-                }
+        runInterningBenchmark(argc > 2 ? max(1, atoi(argv[2])) : 1000000);
+        return 0;
+    }
 
-                try
-                {
-                    login(choice);
-                }
-                catch (InvalidCredentialsException &e)
-                {
-                    cout << e.what() << endl;
-                }
-                catch (std::exception &e)
-                {
-                    cout << "Error: " << e.what() << endl;
-                }
-            }
-            else
-            {
-                try
-                {
-                    currentMenu->displayMenu();
-                    int choice;
+    // --follower [max-staleness-ms]: read-only replica of the patient store
+    if (argc > 1 && strcmp(argv[1], "--follower") == 0)
+    {
+        runFollower(argc > 2 ? max(10, atoi(argv[2])) : 1000);
+        return 0;
+    }
 
-                    if (dynamic_cast<Admin *>(currentUser))
-                        choice = getChoice(1, 3);
-                    else if (dynamic_cast<Doctor *>(currentUser))
-                        choice = getChoice(1, 4);
-                    else if (dynamic_cast<Receptionist *>(currentUser))
-                        choice = getChoice(1, 3);
+    // --bench-replicas [max-replicas]
+    if (argc > 1 && strcmp(argv[1], "--bench-replicas") == 0)
+    {
+        runReplicaBenchmark(argc > 2 ? max(1, atoi(argv[2])) : 8);
+        return 0;
+    }
 
-                    if ((dynamic_cast<Admin *>(currentUser) && choice == 3) ||
-                        (dynamic_cast<Doctor *>(currentUser) && choice == 4) ||
-                        (dynamic_cast<Receptionist *>(currentUser) && choice == 3))
-                    {
-                        delete currentUser;
-                        currentUser = nullptr;
-                        delete currentMenu;
-                        currentMenu = nullptr;
-                        continue;
-                    }
-                    currentMenu->handleChoice(choice);
-                }
-                catch (HospitalException &e)
-                {
-                    cout << "Hospital system error: " << e.what() << endl;
-                }
-                catch (std::exception &e)
-                {
-                    cout << "Error occurred: " << e.what() << endl;
-                }
-            }
+    // --bench-schema [records]
+    if (argc > 1 && strcmp(argv[1], "--bench-schema") == 0)
+    {
+        runSchemaBenchmark(argc > 2 ? max(1, atoi(argv[2])) : 1000000);
+        return 0;
+    }
+
+    // --bench-beds [beds]
+    if (argc > 1 && strcmp(argv[1], "--bench-beds") == 0)
+    {
+        runBedBenchmark(argc > 2 ? max(20, atoi(argv[2])) : 4096, 1000000);
+        return 0;
+    }
+
+    // --bench-vitals [samples]
+    if (argc > 1 && strcmp(argv[1], "--bench-vitals") == 0)
+    {
+        runVitalsBenchmark(argc > 2 ? max(1LL, atoll(argv[2])) : 2000000);
+        return 0;
+    }
+
+    // --export csv|jsonl <file> [--threads N]
+    if (argc > 3 && strcmp(argv[1], "--export") == 0 &&
+        (strcmp(argv[2], "csv") == 0 || strcmp(argv[2], "jsonl") == 0))
+    {
+        int threads = max(1, (int)thread::hardware_concurrency());
+        for (int i = 4; i + 1 < argc; i++)
+            if (strcmp(argv[i], "--threads") == 0)
+                threads = max(1, atoi(argv[i + 1]));
+
+        try
+        {
+            // Load the registry first so the timing covers only the export
+            StorageEngine::getInstance();
+            auto started = chrono::steady_clock::now();
+            long long bytes;
+            long long count = RegistryExporter(strcmp(argv[2], "csv") == 0, threads).run(argv[3], bytes);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+            cout << "Exported " << count << " patient(s) to " << argv[3] << " in " << seconds * 1000 << " ms ("
+                 << bytes / seconds / (1 << 20) << " MiB/s)\n";
+        }
+        catch (std::exception &e)
+        {
+            cout << "Error: " << e.what() << endl;
+            return 1;
         }
+        return 0;
+    }
+
+    // --query "<filter>" [--count]: print matching patients, or just how many
+    if (argc > 2 && strcmp(argv[1], "--query") == 0)
+    {
+        // Load the registry first: equality on interned fields is resolved to
+        // a handle at compile time, and the timing should cover only the query
+        StorageEngine::getInstance();
+        PatientQuery query;
+        string error;
+        if (!query.compile(argv[2], error))
+        {
+            cout << "Invalid filter: " << error << "\n";
+            return 1;
+        }
+        bool countOnly = argc > 3 && strcmp(argv[3], "--count") == 0;
+        auto started = chrono::steady_clock::now();
+        long long matches = query.run([countOnly](const Patient &p)
+                                      {
+            if (!countOnly)
+                p.displayShort(); });
+        cout << matches << " patient(s) matched in "
+             << chrono::duration<double, milli>(chrono::steady_clock::now() - started).count() << " ms\n";
+        return 0;
+    }
+
+    // --tail-changes <seq> [--follow]: print the change feed after seq
+    if (argc > 2 && strcmp(argv[1], "--tail-changes") == 0)
+    {
+        ChangeFeed::tail(atoll(argv[2]), argc > 3 && strcmp(argv[3], "--follow") == 0);
+        return 0;
     }
-};
 
-int main()
-{
     try
     {
         Hospital().start();